@@ -268,6 +268,33 @@ esp_err_t bsp_spiffs_unmount(void);
  */
 esp_err_t bsp_sdcard_init(char *mount_point, size_t max_files);
 
+/**
+ * @brief Init SD card with a given bus clock
+ *
+ * Same as bsp_sdcard_init(), which runs the bus at SDMMC_FREQ_HIGHSPEED.
+ * The card is switched to high speed mode for clocks above SDMMC_FREQ_DEFAULT.
+ *
+ * @param mount_point Path where partition should be registered (e.g. "/sdcard")
+ * @param max_files Maximum number of files which can be open at the same time
+ * @param max_freq_khz Bus clock limit in kHz, e.g. SDMMC_FREQ_DEFAULT
+ * @return
+ *    - ESP_OK                  Success
+ *    - ESP_ERR_INVALID_STATE   If the card is already mounted
+ *    - Others                  Fail, see bsp_sdcard_init()
+ */
+esp_err_t bsp_sdcard_init_with_freq(char *mount_point, size_t max_files, uint32_t max_freq_khz);
+
+/**
+ * @brief Check whether a card sits in the slot
+ *
+ * Runs the card identification sequence at the probing clock and releases the
+ * host again, without touching the filesystem. Errors from an empty slot are
+ * not logged.
+ *
+ * @return true if a card answered or is already mounted
+ */
+bool bsp_sdcard_detect(void);
+
 /**
  * @brief Deinit SD card
  *
@@ -278,6 +305,14 @@ esp_err_t bsp_sdcard_init(char *mount_point, size_t max_files);
  */
 esp_err_t bsp_sdcard_deinit(char *mount_point);
 
+/**
+ * @brief Get the SD card handle
+ *
+ * @return
+ *      - SD/MMC card handle, NULL if the card is not mounted
+ */
+sdmmc_card_t *bsp_sdcard_get_handle(void);
+
 /**************************************************************************************************
  *
  * LCD interface
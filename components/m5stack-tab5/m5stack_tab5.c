@@ -569,52 +569,68 @@ static sdmmc_card_t* card;
 
 esp_err_t bsp_sdcard_init(char* mount_point, size_t max_files)
 {
-    esp_err_t ret_val = ESP_OK;
-
-    if (NULL != card) {
-        return ESP_ERR_INVALID_STATE;
-    }
+    return bsp_sdcard_init_with_freq(mount_point, max_files, SDMMC_FREQ_HIGHSPEED);
+}
 
-    /**
-     * @brief Use settings defined above to initialize SD card and mount FAT filesystem.
-     *   Note: esp_vfs_fat_sdmmc/sdspi_mount is all-in-one convenience functions.
-     *   Please check its source code and implement error recovery when developing
-     *   production applications.
-     *
-     */
-    sdmmc_host_t host = SDMMC_HOST_DEFAULT();
-    host.slot         = SDMMC_HOST_SLOT_0;  //
-    // host.slot = SDMMC_HOST_SLOT_1; //
-    host.max_freq_khz                   = SDMMC_FREQ_HIGHSPEED;
+static esp_err_t bsp_sdcard_host_config(sdmmc_host_t* host, sdmmc_slot_config_t* slot_config, uint32_t max_freq_khz)
+{
+    *host      = (sdmmc_host_t)SDMMC_HOST_DEFAULT();
+    host->slot = SDMMC_HOST_SLOT_0;  //
+    // host->slot = SDMMC_HOST_SLOT_1; //
+    host->max_freq_khz                  = max_freq_khz;
     sd_pwr_ctrl_ldo_config_t ldo_config = {
         .ldo_chan_id = BSP_LDO_PROBE_SD_CHAN,  // `LDO_VO4` is used as the SDMMC IO power
     };
     static sd_pwr_ctrl_handle_t pwr_ctrl_handle = NULL;
 
     if (pwr_ctrl_handle == NULL) {
-        ret_val = sd_pwr_ctrl_new_on_chip_ldo(&ldo_config, &pwr_ctrl_handle);
+        esp_err_t ret_val = sd_pwr_ctrl_new_on_chip_ldo(&ldo_config, &pwr_ctrl_handle);
         if (ret_val != ESP_OK) {
             ESP_LOGE(TAG, "Failed to new an on-chip ldo power control driver");
             return ret_val;
         }
     }
-    host.pwr_ctrl_handle = pwr_ctrl_handle;
+    host->pwr_ctrl_handle = pwr_ctrl_handle;
 
     /**
      * @brief This initializes the slot without card detect (CD) and write protect (WP) signals.
      *   Modify slot_config.gpio_cd and slot_config.gpio_wp if your board has these signals.
      *
      */
-    sdmmc_slot_config_t slot_config = SDMMC_SLOT_CONFIG_DEFAULT();
-    slot_config.width               = SDMMC_BUS_WIDTH;
-    slot_config.clk                 = GPIO_SDMMC_CLK;
-    slot_config.cmd                 = GPIO_SDMMC_CMD;
-    slot_config.d0                  = GPIO_SDMMC_D0;
-    slot_config.d1                  = GPIO_SDMMC_D1;
-    slot_config.d2                  = GPIO_SDMMC_D2;
-    slot_config.d3                  = GPIO_SDMMC_D3;
-    // slot_config.cd = GPIO_SDMMC_DET;
-    // slot_config.flags |= SDMMC_SLOT_FLAG_INTERNAL_PULLUP;
+    *slot_config       = (sdmmc_slot_config_t)SDMMC_SLOT_CONFIG_DEFAULT();
+    slot_config->width = SDMMC_BUS_WIDTH;
+    slot_config->clk   = GPIO_SDMMC_CLK;
+    slot_config->cmd   = GPIO_SDMMC_CMD;
+    slot_config->d0    = GPIO_SDMMC_D0;
+    slot_config->d1    = GPIO_SDMMC_D1;
+    slot_config->d2    = GPIO_SDMMC_D2;
+    slot_config->d3    = GPIO_SDMMC_D3;
+    // slot_config->cd = GPIO_SDMMC_DET;
+    // slot_config->flags |= SDMMC_SLOT_FLAG_INTERNAL_PULLUP;
+    return ESP_OK;
+}
+
+esp_err_t bsp_sdcard_init_with_freq(char* mount_point, size_t max_files, uint32_t max_freq_khz)
+{
+    esp_err_t ret_val = ESP_OK;
+
+    if (NULL != card) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /**
+     * @brief Use settings defined above to initialize SD card and mount FAT filesystem.
+     *   Note: esp_vfs_fat_sdmmc/sdspi_mount is all-in-one convenience functions.
+     *   Please check its source code and implement error recovery when developing
+     *   production applications.
+     *
+     */
+    sdmmc_host_t host;
+    sdmmc_slot_config_t slot_config;
+    ret_val = bsp_sdcard_host_config(&host, &slot_config, max_freq_khz);
+    if (ret_val != ESP_OK) {
+        return ret_val;
+    }
 
     /**
      * @brief Options for mounting the filesystem.
@@ -667,6 +683,47 @@ esp_err_t bsp_sdcard_deinit(char* mount_point)
     return ret_val;
 }
 
+sdmmc_card_t* bsp_sdcard_get_handle(void)
+{
+    return card;
+}
+
+bool bsp_sdcard_detect(void)
+{
+    if (NULL != card) {
+        return true;
+    }
+
+    sdmmc_host_t host;
+    sdmmc_slot_config_t slot_config;
+    if (bsp_sdcard_host_config(&host, &slot_config, SDMMC_FREQ_PROBING) != ESP_OK) {
+        return false;
+    }
+    if (sdmmc_host_init() != ESP_OK) {
+        return false;
+    }
+
+    // An empty slot is the normal case here, keep the card init errors out of the log
+    static const char* sdmmc_tags[] = {"sdmmc_init", "sdmmc_common", "sdmmc_req"};
+    esp_log_level_t levels[sizeof(sdmmc_tags) / sizeof(sdmmc_tags[0])];
+    for (size_t i = 0; i < sizeof(sdmmc_tags) / sizeof(sdmmc_tags[0]); i++) {
+        levels[i] = esp_log_level_get(sdmmc_tags[i]);
+        esp_log_level_set(sdmmc_tags[i], ESP_LOG_NONE);
+    }
+
+    bool present = false;
+    sdmmc_card_t probe_card;
+    if (sdmmc_host_init_slot(host.slot, &slot_config) == ESP_OK) {
+        present = sdmmc_card_init(&host, &probe_card) == ESP_OK;
+    }
+
+    for (size_t i = 0; i < sizeof(sdmmc_tags) / sizeof(sdmmc_tags[0]); i++) {
+        esp_log_level_set(sdmmc_tags[i], levels[i]);
+    }
+    sdmmc_host_deinit();
+    return present;
+}
+
 //==================================================================================
 // spiffs
 //==================================================================================
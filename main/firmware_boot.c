@@ -1,4 +1,5 @@
 #include "firmware_loader.h"
+#include "firmware_slots.h"
 #include "esp_log.h"
 #include "esp_ota_ops.h"
 #include "esp_partition.h"
@@ -24,6 +25,12 @@ esp_err_t firmware_loader_init_boot_manager(void) {
         return ret;
     }
     
+    ret = firmware_slots_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize firmware slots: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    
     ESP_LOGI(TAG, "Boot manager initialized");
     return ESP_OK;
 }
@@ -61,11 +68,13 @@ esp_err_t firmware_loader_handle_boot_management(void) {
 }
 
 esp_err_t firmware_loader_boot_firmware_once(void) {
-    const esp_partition_t *ota_partition = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
-    if (!ota_partition) {
-        ESP_LOGE(TAG, "OTA_0 partition not found");
+    int slot = firmware_slots_most_recent();
+    if (slot < 0) {
+        ESP_LOGE(TAG, "No firmware installed");
         return ESP_ERR_NOT_FOUND;
     }
+    const esp_partition_t *ota_partition = firmware_slots_get(slot)->partition;
+    ESP_LOGI(TAG, "Booting %s from slot %d (%s)", firmware_slots_get(slot)->name, slot, ota_partition->label);
     
     nvs_handle_t nvs_handle;
     esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
@@ -0,0 +1,480 @@
+#include "firmware_catalog.h"
+#include "firmware_loader.h"
+#include "sd_manager.h"
+#include "psram_arena.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const char *TAG = "FIRMWARE_CATALOG";
+
+#define CATALOG_MAGIC       0x54414346      // "FCAT"
+#define CATALOG_VERSION     3
+#define CATALOG_MAX_SIZE    (4 * 1024 * 1024)
+#define CATALOG_TMP_PATH    FIRMWARE_CATALOG_DIR "/catalog.tmp"
+#define STRING_ARENA_CHUNK  (8 * 1024)
+#define INITIAL_CAPACITY    16
+
+#define CATALOG_FLAG_DIGEST     0x01
+#define CATALOG_FLAG_IMAGE      0x02
+
+// On-card layout: header, directory records, entry records, each record followed by its path
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t dir_count;
+    uint32_t entry_count;
+    uint32_t crc;                           // CRC32 of everything after the header
+} catalog_header_t;
+
+typedef struct {
+    uint32_t entry_count;
+    uint32_t signature;
+    uint16_t path_len;
+    uint16_t reserved;
+} catalog_dir_record_t;
+
+typedef struct {
+    uint32_t size;
+    uint32_t image_size;
+    int64_t mtime;
+    uint8_t digest[FIRMWARE_DIGEST_LEN];
+    firmware_image_info_t image;
+    uint16_t dir;
+    uint16_t path_len;
+    uint8_t flags;
+    uint8_t reserved[3];
+} catalog_entry_record_t;
+
+typedef struct {
+    const char *path;
+    uint32_t entry_count;
+    uint32_t signature;
+    bool current;                           // Checked against the card since it was mounted
+} catalog_dir_t;
+
+typedef struct {
+    firmware_catalog_entry_t entry;
+    uint16_t dir;                           // Index into dirs
+} catalog_item_t;
+
+typedef struct {
+    catalog_dir_t *dirs;
+    size_t dir_count;
+    size_t dir_capacity;
+    catalog_item_t *items;
+    size_t item_count;
+    size_t item_capacity;
+    psram_arena_t strings;                  // Paths
+} catalog_t;
+
+static catalog_t active;
+static catalog_t staging;
+static int staging_dir = -1;                // Directory being replaced, -1 when idle
+static bool loaded = false;
+static uint32_t loaded_generation;          // Card the catalog was loaded from
+
+static esp_err_t grow(void **array, size_t *capacity, size_t count, size_t item_size) {
+    if (count < *capacity) {
+        return ESP_OK;
+    }
+    size_t new_capacity = *capacity ? *capacity * 2 : INITIAL_CAPACITY;
+    void *grown = heap_caps_realloc(*array, new_capacity * item_size, MALLOC_CAP_SPIRAM);
+    if (!grown) {
+        return ESP_ERR_NO_MEM;
+    }
+    *array = grown;
+    *capacity = new_capacity;
+    return ESP_OK;
+}
+
+static void catalog_init(catalog_t *catalog) {
+    memset(catalog, 0, sizeof(*catalog));
+    psram_arena_init(&catalog->strings, STRING_ARENA_CHUNK);
+}
+
+static void catalog_free(catalog_t *catalog) {
+    heap_caps_free(catalog->dirs);
+    heap_caps_free(catalog->items);
+    psram_arena_destroy(&catalog->strings);
+    catalog_init(catalog);
+}
+
+static int catalog_add_dir(catalog_t *catalog, const char *path, uint32_t entry_count, uint32_t signature) {
+    if (grow((void **)&catalog->dirs, &catalog->dir_capacity, catalog->dir_count, sizeof(catalog_dir_t)) != ESP_OK) {
+        return -1;
+    }
+    const char *path_copy = psram_arena_strdup(&catalog->strings, path);
+    if (!path_copy) {
+        return -1;
+    }
+    catalog->dirs[catalog->dir_count] = (catalog_dir_t) {
+        .path = path_copy,
+        .entry_count = entry_count,
+        .signature = signature,
+    };
+    return (int)catalog->dir_count++;
+}
+
+static esp_err_t catalog_add_item(catalog_t *catalog, const firmware_catalog_entry_t *entry, uint16_t dir) {
+    esp_err_t ret = grow((void **)&catalog->items, &catalog->item_capacity, catalog->item_count, sizeof(catalog_item_t));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    catalog_item_t *item = &catalog->items[catalog->item_count];
+    item->entry = *entry;
+    item->entry.path = psram_arena_strdup(&catalog->strings, entry->path);
+    item->dir = dir;
+    if (!item->entry.path) {
+        return ESP_ERR_NO_MEM;
+    }
+    catalog->item_count++;
+    return ESP_OK;
+}
+
+static int catalog_find_dir(const catalog_t *catalog, const char *path) {
+    for (size_t i = 0; i < catalog->dir_count; i++) {
+        if (strcmp(catalog->dirs[i].path, path) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static esp_err_t parse(catalog_t *catalog, const uint8_t *data, size_t size) {
+    const catalog_header_t *header = (const catalog_header_t *)data;
+    if (size < sizeof(*header) || header->magic != CATALOG_MAGIC || header->version != CATALOG_VERSION) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if (esp_rom_crc32_le(0, data + sizeof(*header), size - sizeof(*header)) != header->crc) {
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    size_t offset = sizeof(*header);
+    char path[MAX_FIRMWARE_PATH_LEN];
+    for (uint16_t i = 0; i < header->dir_count; i++) {
+        catalog_dir_record_t record;
+        if (offset + sizeof(record) > size) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(&record, data + offset, sizeof(record));
+        offset += sizeof(record);
+        if (record.path_len >= sizeof(path) || offset + record.path_len > size) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(path, data + offset, record.path_len);
+        path[record.path_len] = '\0';
+        offset += record.path_len;
+        if (catalog_add_dir(catalog, path, record.entry_count, record.signature) < 0) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    for (uint32_t i = 0; i < header->entry_count; i++) {
+        catalog_entry_record_t record;
+        if (offset + sizeof(record) > size) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(&record, data + offset, sizeof(record));
+        offset += sizeof(record);
+        if (record.dir >= catalog->dir_count || record.path_len >= sizeof(path) || offset + record.path_len > size) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(path, data + offset, record.path_len);
+        path[record.path_len] = '\0';
+        offset += record.path_len;
+
+        firmware_catalog_entry_t entry = {
+            .path = path,
+            .size = record.size,
+            .image_size = record.image_size,
+            .mtime = record.mtime,
+            .has_digest = (record.flags & CATALOG_FLAG_DIGEST) != 0,
+            .has_image = (record.flags & CATALOG_FLAG_IMAGE) != 0,
+            .image = record.image,
+        };
+        memcpy(entry.digest, record.digest, sizeof(entry.digest));
+        esp_err_t ret = catalog_add_item(catalog, &entry, record.dir);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    return ESP_OK;
+}
+
+static void load(void) {
+    uint32_t generation = sd_manager_get_card_generation();
+    if (loaded && generation == loaded_generation) {
+        return;
+    }
+    if (loaded) {
+        // The card was swapped, a scan staged for the old one must not be saved
+        ESP_LOGI(TAG, "Card changed, reloading catalog");
+        catalog_free(&active);
+        catalog_free(&staging);
+        staging_dir = -1;
+    }
+    loaded = true;
+    loaded_generation = generation;
+    catalog_init(&active);
+    catalog_init(&staging);
+
+    size_t size = sd_manager_get_file_size(FIRMWARE_CATALOG_PATH);
+    if (size == 0 || size > CATALOG_MAX_SIZE) {
+        return;
+    }
+    uint8_t *data = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (!data) {
+        return;
+    }
+
+    // The whole catalog in a single read
+    sd_request_t request = {
+        .type = SD_REQUEST_READ,
+        .path = FIRMWARE_CATALOG_PATH,
+        .read = { .buffer = data, .length = size },
+    };
+    esp_err_t ret = sd_manager_execute(&request, SD_PRIORITY_LOW);
+    if (ret == ESP_OK) {
+        ret = request.read.bytes_read == size ? parse(&active, data, size) : ESP_ERR_INVALID_SIZE;
+    }
+    heap_caps_free(data);
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Ignoring catalog: %s", esp_err_to_name(ret));
+        catalog_free(&active);
+        return;
+    }
+    ESP_LOGI(TAG, "Loaded %u entries in %u directories", (unsigned)active.item_count, (unsigned)active.dir_count);
+}
+
+static esp_err_t save(const catalog_t *catalog) {
+    size_t size = sizeof(catalog_header_t);
+    for (size_t i = 0; i < catalog->dir_count; i++) {
+        size += sizeof(catalog_dir_record_t) + strlen(catalog->dirs[i].path);
+    }
+    for (size_t i = 0; i < catalog->item_count; i++) {
+        size += sizeof(catalog_entry_record_t) + strlen(catalog->items[i].entry.path);
+    }
+
+    uint8_t *data = heap_caps_calloc(1, size, MALLOC_CAP_SPIRAM);
+    if (!data) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    size_t offset = sizeof(catalog_header_t);
+    for (size_t i = 0; i < catalog->dir_count; i++) {
+        const catalog_dir_t *dir = &catalog->dirs[i];
+        catalog_dir_record_t record = {
+            .entry_count = dir->entry_count,
+            .signature = dir->signature,
+            .path_len = strlen(dir->path),
+        };
+        memcpy(data + offset, &record, sizeof(record));
+        offset += sizeof(record);
+        memcpy(data + offset, dir->path, record.path_len);
+        offset += record.path_len;
+    }
+    for (size_t i = 0; i < catalog->item_count; i++) {
+        const firmware_catalog_entry_t *entry = &catalog->items[i].entry;
+        catalog_entry_record_t record = {
+            .size = entry->size,
+            .image_size = entry->image_size,
+            .mtime = entry->mtime,
+            .dir = catalog->items[i].dir,
+            .path_len = strlen(entry->path),
+            .image = entry->image,
+            .flags = (entry->has_digest ? CATALOG_FLAG_DIGEST : 0) | (entry->has_image ? CATALOG_FLAG_IMAGE : 0),
+        };
+        memcpy(record.digest, entry->digest, sizeof(record.digest));
+        memcpy(data + offset, &record, sizeof(record));
+        offset += sizeof(record);
+        memcpy(data + offset, entry->path, record.path_len);
+        offset += record.path_len;
+    }
+
+    catalog_header_t header = {
+        .magic = CATALOG_MAGIC,
+        .version = CATALOG_VERSION,
+        .dir_count = catalog->dir_count,
+        .entry_count = catalog->item_count,
+        .crc = esp_rom_crc32_le(0, data + sizeof(header), size - sizeof(header)),
+    };
+    memcpy(data, &header, sizeof(header));
+
+    esp_err_t ret = sd_manager_fs_acquire();
+    if (ret != ESP_OK) {
+        heap_caps_free(data);
+        return ret;
+    }
+
+    char dir_path[64];
+    snprintf(dir_path, sizeof(dir_path), "%s%s", SD_MOUNT_POINT, FIRMWARE_CATALOG_DIR);
+    mkdir(dir_path, 0775);
+
+    FILE *file = sd_manager_open_file(CATALOG_TMP_PATH, "wb");
+    if (!file) {
+        ret = ESP_FAIL;
+    } else {
+        if (fwrite(data, 1, size, file) != size) {
+            ret = ESP_FAIL;
+        }
+        if (sd_manager_close_file(file) != 0) {
+            ret = ESP_FAIL;
+        }
+    }
+    heap_caps_free(data);
+
+    // FAT rename does not replace, a crash in between only costs a rescan
+    char tmp_path[64];
+    char final_path[64];
+    snprintf(tmp_path, sizeof(tmp_path), "%s%s", SD_MOUNT_POINT, CATALOG_TMP_PATH);
+    snprintf(final_path, sizeof(final_path), "%s%s", SD_MOUNT_POINT, FIRMWARE_CATALOG_PATH);
+    if (ret == ESP_OK) {
+        remove(final_path);
+        if (rename(tmp_path, final_path) != 0) {
+            ret = ESP_FAIL;
+        }
+    } else {
+        remove(tmp_path);
+    }
+    sd_manager_fs_release();
+    return ret;
+}
+
+bool firmware_catalog_fill(const char *directory, firmware_list_t *list) {
+    load();
+    int dir = catalog_find_dir(&active, directory);
+    if (dir < 0 || !active.dirs[dir].current) {
+        return false;
+    }
+
+    firmware_list_clear(list);
+    for (size_t i = 0; i < active.item_count; i++) {
+        const catalog_item_t *item = &active.items[i];
+        if (item->dir != dir) {
+            continue;
+        }
+        const char *slash = strrchr(item->entry.path, '/');
+        const firmware_image_info_t *image = &item->entry.image;
+        bool has_desc = item->entry.has_image && image->has_app_desc;
+        firmware_info_t info = {
+            .filename = slash ? slash + 1 : item->entry.path,
+            .full_path = item->entry.path,
+            .size = item->entry.size,
+            .image_size = item->entry.image_size,
+            .project_name = has_desc ? image->project_name : "",
+            .version = has_desc ? image->version : "",
+            .idf_version = has_desc ? image->idf_version : "",
+            .build_date = has_desc ? image->build_date : "",
+            .chip_id = image->chip_id,
+            .compatible = !item->entry.has_image || firmware_image_check_chip(image, NULL, 0) == ESP_OK,
+        };
+        if (firmware_list_add(list, &info) != ESP_OK) {
+            ESP_LOGW(TAG, "Out of memory, firmware list truncated");
+            break;
+        }
+    }
+    return true;
+}
+
+bool firmware_catalog_validate(const char *directory, uint32_t entry_count, uint32_t signature) {
+    load();
+    int dir = catalog_find_dir(&active, directory);
+    if (dir < 0 || active.dirs[dir].entry_count != entry_count || active.dirs[dir].signature != signature) {
+        return false;
+    }
+    active.dirs[dir].current = true;
+    return true;
+}
+
+uint32_t firmware_catalog_signature(uint32_t signature, const char *name, uint32_t size, int64_t mtime) {
+    // FNV-1a over the name, size and time
+    uint32_t hash = signature ? signature : 2166136261u;
+    for (const char *c = name; *c; c++) {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    const uint8_t *bytes = (const uint8_t *)&size;
+    for (size_t i = 0; i < sizeof(size); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    bytes = (const uint8_t *)&mtime;
+    for (size_t i = 0; i < sizeof(mtime); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+const firmware_catalog_entry_t *firmware_catalog_lookup(const char *path, uint32_t size, int64_t mtime) {
+    load();
+    for (size_t i = 0; i < active.item_count; i++) {
+        const firmware_catalog_entry_t *entry = &active.items[i].entry;
+        if (entry->size == size && entry->mtime == mtime && strcmp(entry->path, path) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t firmware_catalog_begin(const char *directory) {
+    load();
+    catalog_free(&staging);
+
+    // Carry every other directory over unchanged
+    int replaced = catalog_find_dir(&active, directory);
+    for (size_t i = 0; i < active.dir_count; i++) {
+        if ((int)i == replaced) {
+            continue;
+        }
+        const catalog_dir_t *dir = &active.dirs[i];
+        int index = catalog_add_dir(&staging, dir->path, dir->entry_count, dir->signature);
+        if (index < 0) {
+            catalog_free(&staging);
+            return ESP_ERR_NO_MEM;
+        }
+        staging.dirs[index].current = dir->current;
+        for (size_t j = 0; j < active.item_count; j++) {
+            if (active.items[j].dir == i && catalog_add_item(&staging, &active.items[j].entry, index) != ESP_OK) {
+                catalog_free(&staging);
+                return ESP_ERR_NO_MEM;
+            }
+        }
+    }
+
+    staging_dir = catalog_add_dir(&staging, directory, 0, 0);
+    if (staging_dir < 0) {
+        catalog_free(&staging);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t firmware_catalog_add(const firmware_catalog_entry_t *entry) {
+    if (staging_dir < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return catalog_add_item(&staging, entry, staging_dir);
+}
+
+esp_err_t firmware_catalog_end(uint32_t entry_count, uint32_t signature) {
+    if (staging_dir < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    staging.dirs[staging_dir].entry_count = entry_count;
+    staging.dirs[staging_dir].signature = signature;
+    staging.dirs[staging_dir].current = true;
+    staging_dir = -1;
+
+    catalog_free(&active);
+    active = staging;
+    catalog_init(&staging);
+
+    esp_err_t ret = save(&active);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to write catalog: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
@@ -0,0 +1,93 @@
+#ifndef FIRMWARE_CATALOG_H
+#define FIRMWARE_CATALOG_H
+
+#include "esp_err.h"
+#include "firmware_digest.h"
+#include "firmware_list.h"
+#include "firmware_image.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define FIRMWARE_CATALOG_DIR  "/.launcher"
+#define FIRMWARE_CATALOG_PATH FIRMWARE_CATALOG_DIR "/catalog.bin"
+
+// What is known about one image file, persisted so it is only probed once
+typedef struct {
+    const char *path;                       // Relative to SD root
+    uint32_t size;                          // Stored size of the file
+    uint32_t image_size;                    // Size once decompressed
+    int64_t mtime;                          // Modification time of the file
+    bool has_digest;                        // digest is valid (plain images with an appended hash)
+    bool has_image;                         // image is valid, the file parsed as an app image
+    uint8_t digest[FIRMWARE_DIGEST_LEN];
+    firmware_image_info_t image;
+} firmware_catalog_entry_t;
+
+/**
+ * @brief List the firmware files of a directory from the catalog, without touching the card
+ * Only answers for directories checked against the card since it was mounted.
+ * The launcher does not write images, so a checked directory stays current
+ * until the card is swapped, which reloads the catalog.
+ * @param directory Directory (relative to SD root)
+ * @param list Cleared, then filled with the catalogued files
+ * @return true if the directory was current and the list was filled
+ */
+bool firmware_catalog_fill(const char *directory, firmware_list_t *list);
+
+/**
+ * @brief Check a directory against the catalog
+ * Loads the catalog file on first use. A match marks the directory current.
+ * @param directory Directory (relative to SD root)
+ * @param entry_count Number of image files in the directory
+ * @param signature Signature of the image files, see firmware_catalog_signature()
+ * @return true if the catalogued directory is unchanged
+ */
+bool firmware_catalog_validate(const char *directory, uint32_t entry_count, uint32_t signature);
+
+/**
+ * @brief Fold one image file into a directory signature
+ * FAT does not update directory timestamps when files change, so directories
+ * are recognised by the names, sizes and times of the files in them.
+ * @param signature Signature so far, 0 for the first file
+ * @param name File name
+ * @param size File size
+ * @param mtime File modification time
+ * @return Updated signature
+ */
+uint32_t firmware_catalog_signature(uint32_t signature, const char *name, uint32_t size, int64_t mtime);
+
+/**
+ * @brief Find a catalogued file that has not changed since it was probed
+ * @param path File path (relative to SD root)
+ * @param size Current size of the file
+ * @param mtime Current modification time of the file
+ * @return Entry, NULL if unknown or changed. Valid until the next firmware_catalog_end().
+ */
+const firmware_catalog_entry_t *firmware_catalog_lookup(const char *path, uint32_t size, int64_t mtime);
+
+/**
+ * @brief Start replacing the entries of one directory
+ * Existing entries stay visible to firmware_catalog_lookup() until firmware_catalog_end().
+ * @param directory Directory (relative to SD root)
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t firmware_catalog_begin(const char *directory);
+
+/**
+ * @brief Add an entry to the directory being replaced
+ * @param entry Entry, its path is copied
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t firmware_catalog_add(const firmware_catalog_entry_t *entry);
+
+/**
+ * @brief Finish replacing a directory and write the catalog back to the card
+ * @param entry_count Number of image files in the directory
+ * @param signature Signature of the image files
+ * @return ESP_OK on success, error code otherwise. The in-memory catalog is
+ *         updated even if it could not be written.
+ */
+esp_err_t firmware_catalog_end(uint32_t entry_count, uint32_t signature);
+
+#endif // FIRMWARE_CATALOG_H
@@ -1,141 +1,200 @@
 #include "firmware_loader.h"
 #include "sd_manager.h"
+#include "flash_engine.h"
+#include "firmware_digest.h"
+#include "firmware_source.h"
+#include "firmware_image.h"
+#include "firmware_slots.h"
+#include "flash_journal.h"
 #include "esp_log.h"
 #include "esp_ota_ops.h"
 #include "esp_partition.h"
-#include "esp_app_format.h"
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
 
 static const char *TAG = "FIRMWARE_CORE";
-#define BUFFER_SIZE 4096
 
-static bool is_valid_firmware_file(const char *filename) {
-    size_t len = strlen(filename);
-    if (len < 4) return false;
-    return (strcmp(&filename[len-4], ".bin") == 0);
-}
-
-static esp_err_t validate_firmware_header(FILE *file) {
-    esp_image_header_t header;
-    
-    fseek(file, 0, SEEK_SET);
-    if (fread(&header, sizeof(header), 1, file) != 1) {
-        ESP_LOGE(TAG, "Failed to read firmware header");
-        return ESP_ERR_INVALID_SIZE;
+static esp_err_t validate_firmware_header(firmware_source_t *source, firmware_image_info_t *image_out) {
+    // Compressed images are checked on their decompressed header
+    firmware_image_info_t image;
+    esp_err_t ret = firmware_image_parse(source, &image);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Not a valid app image: %s", esp_err_to_name(ret));
+        return ret;
     }
     
-    if (header.magic != ESP_IMAGE_HEADER_MAGIC) {
-        ESP_LOGE(TAG, "Invalid firmware magic: 0x%02x", header.magic);
-        return ESP_ERR_INVALID_ARG;
+    // Reject foreign images before a minute of erasing and writing
+    char reason[64];
+    ret = firmware_image_check_chip(&image, reason, sizeof(reason));
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Firmware rejected: %s", reason);
+        return ret;
     }
     
+    if (image.has_app_desc) {
+        ESP_LOGI(TAG, "Firmware %s %s (IDF %s, built %s %s)", image.project_name, image.version,
+                 image.idf_version, image.build_date, image.build_time);
+    }
     ESP_LOGI(TAG, "Firmware header validated successfully");
+    *image_out = image;
     return ESP_OK;
 }
 
+static const char *const step_descriptions[FIRMWARE_STEP_COUNT] = {
+    [FIRMWARE_STEP_IDLE]              = "",
+    [FIRMWARE_STEP_ALREADY_INSTALLED] = "Firmware already installed",
+    [FIRMWARE_STEP_BOOTING_INSTALLED] = "Firmware already installed, booting...",
+    [FIRMWARE_STEP_RESUMING]          = "Resuming interrupted flash...",
+    [FIRMWARE_STEP_STARTING]          = "Starting firmware write...",
+    [FIRMWARE_STEP_WRITING]           = "Writing firmware...",
+    [FIRMWARE_STEP_FINALIZING]        = "Finalizing...",
+    [FIRMWARE_STEP_COMPLETE]          = "Flash complete! Returning to launcher...",
+    [FIRMWARE_STEP_FAILED]            = "Flash failed!",
+    [FIRMWARE_STEP_WRONG_CHIP]        = "Firmware is built for another chip!",
+};
+
+const char *firmware_loader_step_description(firmware_step_t step) {
+    if ((unsigned)step >= FIRMWARE_STEP_COUNT) {
+        return "";
+    }
+    return step_descriptions[step];
+}
+
 esp_err_t firmware_loader_init(void) {
     ESP_LOGI(TAG, "Firmware loader initialized");
     return ESP_OK;
 }
 
+int firmware_loader_installed_slot(const char *firmware_path) {
+    if (!sd_manager_is_mounted()) {
+        return -1;
+    }
+    
+    // Slot keys are kept in NVS, so this never touches flash
+    uint8_t file_key[FIRMWARE_DIGEST_LEN];
+    if (firmware_digest_key_of_file(firmware_path, file_key) != ESP_OK) {
+        return -1;
+    }
+    return firmware_slots_find(file_key);
+}
+
+bool firmware_loader_is_installed(const char *firmware_path) {
+    return firmware_loader_installed_slot(firmware_path) >= 0;
+}
+
 esp_err_t firmware_loader_flash_from_sd_with_progress(const char *firmware_path, firmware_progress_callback_t progress_callback) {
     if (!sd_manager_is_mounted()) {
         ESP_LOGE(TAG, "SD card not mounted");
         return ESP_ERR_INVALID_STATE;
     }
     
-    if (!is_valid_firmware_file(firmware_path)) {
+    if (!firmware_source_is_image_file(firmware_path)) {
         ESP_LOGE(TAG, "Invalid firmware file: %s", firmware_path);
         return ESP_ERR_INVALID_ARG;
     }
     
-    FILE *file = sd_manager_open_file(firmware_path, "rb");
-    if (!file) {
-        ESP_LOGE(TAG, "Failed to open firmware file: %s", firmware_path);
-        return ESP_ERR_NOT_FOUND;
+    int installed_slot = firmware_loader_installed_slot(firmware_path);
+    if (installed_slot >= 0) {
+        // Make it the one firmware_loader_boot_firmware_once() picks
+        ESP_LOGI(TAG, "%s is already installed in slot %d, skipping flash", firmware_path, installed_slot);
+        firmware_slots_touch(installed_slot);
+        if (progress_callback) progress_callback(1, 1, FIRMWARE_STEP_ALREADY_INSTALLED);
+        return ESP_OK;
     }
     
-    esp_err_t ret = validate_firmware_header(file);
+    firmware_source_t *source = NULL;
+    esp_err_t ret = firmware_source_open(firmware_path, &source);
     if (ret != ESP_OK) {
-        fclose(file);
+        ESP_LOGE(TAG, "Failed to open firmware file: %s", firmware_path);
         return ret;
     }
     
-    fseek(file, 0, SEEK_END);
-    size_t file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    
-    ESP_LOGI(TAG, "Firmware file size: %zu bytes", file_size);
-    
-    const esp_partition_t *update_partition = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
-    
-    if (!update_partition) {
-        ESP_LOGE(TAG, "OTA_0 partition not found");
-        fclose(file);
-        return ESP_ERR_NOT_FOUND;
+    firmware_image_info_t image;
+    ret = validate_firmware_header(source, &image);
+    if (ret != ESP_OK) {
+        firmware_source_close(source);
+        return ret;
     }
     
-    if (file_size > update_partition->size) {
-        ESP_LOGE(TAG, "Firmware too large: %zu > %" PRIu32, file_size, update_partition->size);
-        fclose(file);
+    size_t file_size = firmware_source_image_size(source);
+    ESP_LOGI(TAG, "Firmware image size: %zu bytes%s", file_size,
+             firmware_source_compression(source) == FIRMWARE_COMPRESSION_GZIP ? " (gzip)" : "");
+    
+    // Pick up where an interrupted flash of the same file left off
+    flash_journal_t journal;
+    size_t resume_offset = 0;
+    int slot = -1;
+    if (flash_journal_load(&journal) == ESP_OK && flash_journal_matches(&journal, firmware_path, file_size) &&
+        firmware_slots_get(journal.slot) && firmware_slots_get(journal.slot)->partition->size >= file_size) {
+        slot = journal.slot;
+        resume_offset = journal.committed;
+        ESP_LOGI(TAG, "Resuming interrupted flash at %zu / %zu bytes", resume_offset, file_size);
+        if (progress_callback) progress_callback(resume_offset, file_size, FIRMWARE_STEP_RESUMING);
+    } else {
+        slot = firmware_slots_select(file_size);
+    }
+    if (slot < 0) {
+        ESP_LOGE(TAG, "Firmware too large for any slot: %zu bytes", file_size);
+        firmware_source_close(source);
         return ESP_ERR_INVALID_SIZE;
     }
+    const esp_partition_t *update_partition = firmware_slots_get(slot)->partition;
     
-    if (progress_callback) progress_callback(0, file_size, "Erasing partition...");
-    ret = esp_partition_erase_range(update_partition, 0, update_partition->size);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to erase partition: %s", esp_err_to_name(ret));
-        fclose(file);
-        return ret;
-    }
+    // Reflashing over an evicted image only rewrites the blocks that changed
+    bool differential = firmware_slots_get(slot)->occupied;
+    ESP_LOGI(TAG, "Flashing into slot %d (%s), mode: %s", slot, update_partition->label,
+             differential ? "differential" : "full");
     
-    if (progress_callback) progress_callback(0, file_size, "Starting firmware write...");
-    esp_ota_handle_t update_handle = 0;
-    ret = esp_ota_begin(update_partition, file_size, &update_handle);
+    // Forget the old image first so an interrupted flash never leaves a stale record
+    ret = firmware_slots_release(slot);
+    if (ret == ESP_OK && resume_offset == 0) {
+        ret = flash_journal_begin(&journal, firmware_path, slot, file_size);
+    }
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "esp_ota_begin failed: %s", esp_err_to_name(ret));
-        fclose(file);
+        firmware_source_close(source);
         return ret;
     }
     
-    // Flash firmware in chunks
-    uint8_t buffer[BUFFER_SIZE];
-    size_t bytes_written = 0;
+    flash_engine_job_t job = {
+        .source = source,
+        .image_size = file_size,
+        .hash_offset = image.hash_offset,     // 0 for compressed images, the gzip CRC32 covers those
+        .partition = update_partition,
+        .differential = differential,
+        .resume_offset = resume_offset,
+        .journal = &journal,
+        .progress_callback = progress_callback,
+    };
+    flash_engine_stats_t stats;
+    firmware_digest_invalidate_partition(update_partition);
+    ret = flash_engine_run(&job, &stats);
+    firmware_source_close(source);
     
-    while (bytes_written < file_size) {
-        size_t bytes_to_read = (file_size - bytes_written > BUFFER_SIZE) ? BUFFER_SIZE : (file_size - bytes_written);
-        size_t bytes_read = fread(buffer, 1, bytes_to_read, file);
-        
-        if (bytes_read == 0) {
-            ESP_LOGE(TAG, "Failed to read from file");
-            esp_ota_abort(update_handle);
-            fclose(file);
-            return ESP_ERR_INVALID_STATE;
-        }
-        
-        ret = esp_ota_write(update_handle, buffer, bytes_read);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "esp_ota_write failed: %s", esp_err_to_name(ret));
-            esp_ota_abort(update_handle);
-            fclose(file);
-            return ret;
-        }
-        
-        bytes_written += bytes_read;
-        
-        if (progress_callback) {
-            progress_callback(bytes_written, file_size, "Writing firmware...");
+    if (ret != ESP_OK) {
+        // An interrupted copy keeps its journal so a retry resumes instead of starting
+        // over, but resuming a file that failed validation would only fail again
+        ESP_LOGE(TAG, "Flashing failed: %s", esp_err_to_name(ret));
+        if (ret == ESP_ERR_INVALID_ARG || ret == ESP_ERR_INVALID_CRC || ret == ESP_ERR_OTA_VALIDATE_FAILED) {
+            flash_journal_clear();
         }
+        return ret;
     }
     
-    fclose(file);
+    flash_journal_clear();
+    flash_engine_log_stats(&stats);
     
-    if (progress_callback) progress_callback(file_size, file_size, "Finalizing...");
-    ret = esp_ota_end(update_handle);
+    // Key the slot by the file so later lookups match without reading flash,
+    // falling back to the image's own digest if the file cannot be read now
+    uint8_t digest[FIRMWARE_DIGEST_LEN];
+    if (firmware_digest_key_of_file(firmware_path, digest) != ESP_OK &&
+        firmware_digest_of_partition(update_partition, digest) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to get digest of the flashed image");
+        return ESP_ERR_INVALID_STATE;
+    }
+    const char *name = strrchr(firmware_path, '/');
+    ret = firmware_slots_record(slot, name ? name + 1 : firmware_path, digest);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "esp_ota_end failed: %s", esp_err_to_name(ret));
         return ret;
     }
     
@@ -144,16 +203,5 @@ esp_err_t firmware_loader_flash_from_sd_with_progress(const char *firmware_path,
 }
 
 bool firmware_loader_is_firmware_ready(void) {
-    const esp_partition_t *ota_partition = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
-    if (!ota_partition) {
-        return false;
-    }
-    
-    esp_image_header_t header;
-    esp_err_t ret = esp_partition_read(ota_partition, 0, &header, sizeof(header));
-    if (ret != ESP_OK) {
-        return false;
-    }
-    
-    return (header.magic == ESP_IMAGE_HEADER_MAGIC);
-}
\ No newline at end of file
+    return firmware_slots_most_recent() >= 0;
+}
@@ -0,0 +1,250 @@
+#include "firmware_digest.h"
+#include "firmware_loader.h"
+#include "sd_manager.h"
+#include "firmware_source.h"
+#include "esp_log.h"
+#include "esp_app_format.h"
+#include "mbedtls/sha256.h"
+#include "freertos/FreeRTOS.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const char *TAG = "FIRMWARE_DIGEST";
+
+#define FILE_CACHE_SIZE      8
+#define PARTITION_CACHE_SIZE 4
+#define GZIP_TRAILER_SIZE    8          // CRC32 and ISIZE of the uncompressed data
+
+typedef struct {
+    bool valid;
+    char path[MAX_FIRMWARE_PATH_LEN];
+    size_t size;
+    time_t mtime;
+    uint32_t card;                          // Card generation the file was hashed on
+    uint8_t digest[FIRMWARE_DIGEST_LEN];
+} file_digest_entry_t;
+
+typedef struct {
+    bool valid;
+    uint32_t address;
+    uint8_t digest[FIRMWARE_DIGEST_LEN];
+} partition_digest_entry_t;
+
+static file_digest_entry_t file_cache[FILE_CACHE_SIZE];
+static int file_cache_next = 0;
+static partition_digest_entry_t partition_cache[PARTITION_CACHE_SIZE];
+// Discovery and the flash task both look up digests, only held while an entry is copied
+static portMUX_TYPE cache_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// The appended SHA-256 follows the last segment and the checksum byte that pads
+// it to 16 bytes. Signed images carry their signature block after the hash, so
+// the end of the file is not where to look.
+static esp_err_t find_appended_hash(FILE *file, const esp_image_header_t *header, size_t size, long *offset) {
+    if (header->segment_count == 0 || header->segment_count > ESP_IMAGE_MAX_SEGMENTS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t pos = sizeof(esp_image_header_t);
+    for (int i = 0; i < header->segment_count; i++) {
+        esp_image_segment_header_t segment;
+        if (fseek(file, (long)pos, SEEK_SET) != 0 || fread(&segment, sizeof(segment), 1, file) != 1) {
+            return ESP_FAIL;
+        }
+        pos += sizeof(segment) + segment.data_len;
+        if (pos > size) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+    pos = (pos + 1 + 15) & ~(size_t)15;
+    if (pos + FIRMWARE_DIGEST_LEN > size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *offset = (long)pos;
+    return ESP_OK;
+}
+
+static esp_err_t hash_plain_file(const char *path, size_t size, uint8_t *digest) {
+    FILE *file = sd_manager_open_file(path, "rb");
+    if (!file) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_image_header_t header;
+    esp_err_t ret = ESP_OK;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != ESP_IMAGE_HEADER_MAGIC) {
+        ret = ESP_ERR_INVALID_ARG;
+    } else if (header.hash_appended) {
+        // The image already carries its own SHA-256 behind the segments
+        long offset = 0;
+        ret = find_appended_hash(file, &header, size, &offset);
+        if (ret == ESP_OK &&
+            (fseek(file, offset, SEEK_SET) != 0 || fread(digest, FIRMWARE_DIGEST_LEN, 1, file) != 1)) {
+            ret = ESP_FAIL;
+        }
+    } else {
+        // Bulk work for the SD task, it keeps serving the UI in between
+        sd_manager_close_file(file);
+        sd_request_t request = {
+            .type = SD_REQUEST_HASH,
+            .path = path,
+        };
+        ret = sd_manager_execute(&request, SD_PRIORITY_LOW);
+        if (ret == ESP_OK) {
+            memcpy(digest, request.hash.digest, FIRMWARE_DIGEST_LEN);
+        }
+        return ret;
+    }
+    sd_manager_close_file(file);
+    return ret;
+}
+
+esp_err_t firmware_digest_of_file(const char *path, uint8_t *digest) {
+    // The appended hash of a compressed image is only reachable by inflating all of
+    // it, which costs as much as the flash itself; the differential pass covers it
+    if (firmware_source_compression_of(path) != FIRMWARE_COMPRESSION_NONE) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    char sd_path[MAX_FIRMWARE_PATH_LEN + sizeof(SD_MOUNT_POINT)];
+    snprintf(sd_path, sizeof(sd_path), "%s%s", SD_MOUNT_POINT, path);
+
+    struct stat st;
+    esp_err_t ret = sd_manager_fs_acquire();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    int stat_ret = stat(sd_path, &st);
+    sd_manager_fs_release();
+    if (stat_ret != 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint32_t card = sd_manager_get_card_generation();
+    bool hit = false;
+    taskENTER_CRITICAL(&cache_lock);
+    for (int i = 0; i < FILE_CACHE_SIZE && !hit; i++) {
+        file_digest_entry_t *e = &file_cache[i];
+        if (e->valid && e->card == card && e->size == (size_t)st.st_size && e->mtime == st.st_mtime &&
+            strcmp(e->path, path) == 0) {
+            memcpy(digest, e->digest, FIRMWARE_DIGEST_LEN);
+            hit = true;
+        }
+    }
+    taskEXIT_CRITICAL(&cache_lock);
+    if (hit) {
+        return ESP_OK;
+    }
+
+    ret = hash_plain_file(path, st.st_size, digest);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Could not get digest of %s: %s", path, esp_err_to_name(ret));
+        return ret;
+    }
+
+    // Hashing ran unlocked, the entry is only written once the digest is known
+    taskENTER_CRITICAL(&cache_lock);
+    file_digest_entry_t *e = &file_cache[file_cache_next];
+    file_cache_next = (file_cache_next + 1) % FILE_CACHE_SIZE;
+    strncpy(e->path, path, sizeof(e->path) - 1);
+    e->path[sizeof(e->path) - 1] = '\0';
+    e->size = st.st_size;
+    e->mtime = st.st_mtime;
+    e->card = card;
+    memcpy(e->digest, digest, FIRMWARE_DIGEST_LEN);
+    e->valid = true;
+    taskEXIT_CRITICAL(&cache_lock);
+    return ESP_OK;
+}
+
+// A compressed file is named by its gzip trailer and stored size, hashed so the
+// key has the digest's length. It never equals the SHA-256 of an actual image.
+static esp_err_t gzip_file_key(const char *path, uint8_t *key) {
+    sd_raw_file_t *file;
+    esp_err_t ret = sd_manager_raw_open(path, &file);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // "gzip" tag, then the trailer, then the stored size, little endian
+    uint8_t id[4 + GZIP_TRAILER_SIZE + 4] = { 'g', 'z', 'i', 'p' };
+    size_t size = sd_manager_raw_size(file);
+    size_t got = 0;
+    if (size < GZIP_TRAILER_SIZE || sd_manager_raw_seek(file, size - GZIP_TRAILER_SIZE) != ESP_OK ||
+        sd_manager_raw_read(file, id + 4, GZIP_TRAILER_SIZE, &got) != ESP_OK || got != GZIP_TRAILER_SIZE) {
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+    sd_manager_raw_close(file);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        id[4 + GZIP_TRAILER_SIZE + i] = (uint8_t)(size >> (8 * i));
+    }
+    return mbedtls_sha256(id, sizeof(id), key, 0) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t firmware_digest_key_of_file(const char *path, uint8_t *key) {
+    if (firmware_source_compression_of(path) == FIRMWARE_COMPRESSION_GZIP) {
+        return gzip_file_key(path, key);
+    }
+    return firmware_digest_of_file(path, key);
+}
+
+static bool find_partition_digest(uint32_t address, uint8_t *digest) {
+    bool hit = false;
+    taskENTER_CRITICAL(&cache_lock);
+    for (int i = 0; i < PARTITION_CACHE_SIZE && !hit; i++) {
+        partition_digest_entry_t *e = &partition_cache[i];
+        if (e->valid && e->address == address) {
+            memcpy(digest, e->digest, FIRMWARE_DIGEST_LEN);
+            hit = true;
+        }
+    }
+    taskEXIT_CRITICAL(&cache_lock);
+    return hit;
+}
+
+esp_err_t firmware_digest_of_partition(const esp_partition_t *partition, uint8_t *digest) {
+    if (find_partition_digest(partition->address, digest)) {
+        return ESP_OK;
+    }
+
+    // For app partitions this returns the image's appended hash after validating it
+    esp_err_t ret = esp_partition_get_sha256(partition, digest);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // Another task may have cached it meanwhile, or taken the free entry
+    taskENTER_CRITICAL(&cache_lock);
+    partition_digest_entry_t *slot = NULL;
+    for (int i = 0; i < PARTITION_CACHE_SIZE; i++) {
+        partition_digest_entry_t *e = &partition_cache[i];
+        if (e->valid && e->address == partition->address) {
+            slot = NULL;
+            break;
+        }
+        if (!e->valid && !slot) {
+            slot = e;
+        }
+    }
+    if (slot) {
+        slot->address = partition->address;
+        memcpy(slot->digest, digest, FIRMWARE_DIGEST_LEN);
+        slot->valid = true;
+    }
+    taskEXIT_CRITICAL(&cache_lock);
+    return ESP_OK;
+}
+
+void firmware_digest_invalidate_partition(const esp_partition_t *partition) {
+    taskENTER_CRITICAL(&cache_lock);
+    for (int i = 0; i < PARTITION_CACHE_SIZE; i++) {
+        if (partition_cache[i].address == partition->address) {
+            partition_cache[i].valid = false;
+        }
+    }
+    taskEXIT_CRITICAL(&cache_lock);
+}
@@ -0,0 +1,47 @@
+#ifndef FIRMWARE_DIGEST_H
+#define FIRMWARE_DIGEST_H
+
+#include "esp_err.h"
+#include "esp_partition.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FIRMWARE_DIGEST_LEN 32
+
+/**
+ * @brief Get the SHA-256 digest of an image file on the SD card
+ * Uses the hash esptool appends behind the segments when present, otherwise hashes
+ * the whole file. Results are cached by path, size and modification time.
+ * @param path File path (relative to SD root)
+ * @param digest Output buffer of FIRMWARE_DIGEST_LEN bytes
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED for compressed images, error code otherwise
+ */
+esp_err_t firmware_digest_of_file(const char *path, uint8_t *digest);
+
+/**
+ * @brief Get a key that identifies an image file on the SD card
+ * Same as firmware_digest_of_file() for plain images. Compressed images are
+ * keyed by their gzip trailer (CRC32 and uncompressed size) and stored size,
+ * which is read from the end of the file without inflating anything.
+ * @param path File path (relative to SD root)
+ * @param key Output buffer of FIRMWARE_DIGEST_LEN bytes
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t firmware_digest_key_of_file(const char *path, uint8_t *key);
+
+/**
+ * @brief Get the SHA-256 digest of the app image stored in a partition
+ * Cached until firmware_digest_invalidate_partition() is called.
+ * @param partition App partition
+ * @param digest Output buffer of FIRMWARE_DIGEST_LEN bytes
+ * @return ESP_OK on success, error code if the partition holds no valid image
+ */
+esp_err_t firmware_digest_of_partition(const esp_partition_t *partition, uint8_t *digest);
+
+/**
+ * @brief Drop the cached digest of a partition, call before writing to it
+ * @param partition App partition
+ */
+void firmware_digest_invalidate_partition(const esp_partition_t *partition);
+
+#endif // FIRMWARE_DIGEST_H
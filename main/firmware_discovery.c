@@ -0,0 +1,252 @@
+#include "firmware_discovery.h"
+#include "firmware_loader.h"
+#include "sd_manager.h"
+#include "psram_arena.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+
+static const char *TAG = "FIRMWARE_DISCOVERY";
+
+#define DISCOVERY_TASK_STACK    6144
+#define DISCOVERY_TASK_PRIORITY 3       // Below the flash task, which cancels discovery anyway
+#define BATCH_QUEUE_LENGTH      8
+#define SEND_RETRY_MS           50
+#define PATH_ARENA_CHUNK        (8 * 1024)
+#define INITIAL_PENDING         32
+
+typedef struct {
+    char root[MAX_FIRMWARE_PATH_LEN];
+    int max_depth;
+    unsigned generation;
+} discovery_request_t;
+
+typedef struct {
+    unsigned generation;                // Walk the batch belongs to
+    bool done;                          // Last batch of the walk
+    firmware_list_t *files;             // NULL when the batch only reports completion
+} discovery_batch_t;
+
+typedef struct {
+    const char *path;
+    int depth;
+} pending_dir_t;
+
+static TaskHandle_t discovery_task_handle = NULL;
+static QueueHandle_t request_queue = NULL;     // Latest request only
+static QueueHandle_t batch_queue = NULL;
+static atomic_uint current_generation;          // Bumped by every start and cancel
+
+// Walk state, only touched by the discovery task
+static sd_listing_t *walk_listing = NULL;
+static firmware_list_t *walk_found = NULL;
+static psram_arena_t walk_paths;
+static pending_dir_t *pending = NULL;
+static size_t pending_capacity = 0;
+
+static bool is_cancelled(unsigned generation) {
+    return atomic_load(&current_generation) != generation;
+}
+
+static bool push_pending(size_t count, const char *path, int depth) {
+    if (count == pending_capacity) {
+        size_t capacity = pending_capacity ? pending_capacity * 2 : INITIAL_PENDING;
+        pending_dir_t *grown = heap_caps_realloc(pending, capacity * sizeof(pending_dir_t), MALLOC_CAP_SPIRAM);
+        if (!grown) {
+            return false;
+        }
+        pending = grown;
+        pending_capacity = capacity;
+    }
+    const char *path_copy = psram_arena_strdup(&walk_paths, path);
+    if (!path_copy) {
+        return false;
+    }
+    pending[count] = (pending_dir_t) { .path = path_copy, .depth = depth };
+    return true;
+}
+
+static bool send_batch(discovery_batch_t *batch) {
+    // Wait for the UI to catch up, unless it lost interest
+    while (xQueueSend(batch_queue, batch, pdMS_TO_TICKS(SEND_RETRY_MS)) != pdTRUE) {
+        if (is_cancelled(batch->generation)) {
+            firmware_list_destroy(batch->files);
+            return false;
+        }
+    }
+    return true;
+}
+
+static size_t walk(const discovery_request_t *request) {
+    size_t pending_count = 0;
+    size_t next = 0;
+    size_t total = 0;
+    discovery_batch_t batch = { .generation = request->generation };
+
+    psram_arena_reset(&walk_paths);
+    if (push_pending(pending_count, request->root, 0)) {
+        pending_count++;
+    }
+
+    while (next < pending_count && !is_cancelled(request->generation)) {
+        pending_dir_t dir = pending[next++];
+        if (sd_manager_scan_directory(dir.path, walk_listing) < 0) {
+            continue;
+        }
+
+        // Queue subdirectories before probing, the listing is reused by the scan
+        size_t entry_count = sd_listing_count(walk_listing);
+        if (dir.depth < request->max_depth) {
+            size_t dir_len = strlen(dir.path);
+            bool has_slash = dir_len > 0 && dir.path[dir_len - 1] == '/';
+            for (size_t i = 0; i < entry_count; i++) {
+                const file_entry_t *entry = sd_listing_get(walk_listing, i);
+                if (!entry->is_directory) {
+                    continue;
+                }
+                char child[MAX_FIRMWARE_PATH_LEN];
+                int len = snprintf(child, sizeof(child), "%s%s%s", dir.path, has_slash ? "" : "/", entry->name);
+                if (len < 0 || len >= (int)sizeof(child)) {
+                    continue;
+                }
+                if (!push_pending(pending_count, child, dir.depth + 1)) {
+                    ESP_LOGW(TAG, "Out of memory, not descending into %s", child);
+                    break;
+                }
+                pending_count++;
+            }
+        }
+
+        int found = firmware_loader_scan_listing(dir.path, walk_listing, walk_found);
+        for (int i = 0; i < found; i++) {
+            if (!batch.files) {
+                batch.files = firmware_list_create();
+                if (!batch.files) {
+                    break;
+                }
+            }
+            if (firmware_list_add(batch.files, firmware_list_get(walk_found, i)) != ESP_OK) {
+                break;
+            }
+            total++;
+            if (firmware_list_count(batch.files) >= FIRMWARE_DISCOVERY_BATCH_SIZE) {
+                if (!send_batch(&batch)) {
+                    return total;
+                }
+                batch.files = NULL;
+            }
+        }
+
+        // Flush per directory so a slow subtree does not hold back what was found
+        if (batch.files) {
+            if (!send_batch(&batch)) {
+                return total;
+            }
+            batch.files = NULL;
+        }
+    }
+
+    if (is_cancelled(request->generation)) {
+        return total;
+    }
+    batch.done = true;
+    send_batch(&batch);
+    return total;
+}
+
+static void discovery_task(void *arg) {
+    discovery_request_t request;
+    while (true) {
+        if (xQueueReceive(request_queue, &request, portMAX_DELAY) != pdTRUE || is_cancelled(request.generation)) {
+            continue;
+        }
+
+        int64_t start = esp_timer_get_time();
+        size_t total = walk(&request);
+        ESP_LOGI(TAG, "%s %u firmware files under %s in %lld ms",
+                 is_cancelled(request.generation) ? "Cancelled after" : "Found", (unsigned)total,
+                 request.root, (long long)((esp_timer_get_time() - start) / 1000));
+    }
+}
+
+static void discard_batches(void) {
+    discovery_batch_t batch;
+    while (xQueueReceive(batch_queue, &batch, 0) == pdTRUE) {
+        firmware_list_destroy(batch.files);
+    }
+}
+
+static esp_err_t start_task(void) {
+    walk_listing = sd_listing_create();
+    walk_found = firmware_list_create();
+    request_queue = xQueueCreate(1, sizeof(discovery_request_t));
+    batch_queue = xQueueCreate(BATCH_QUEUE_LENGTH, sizeof(discovery_batch_t));
+    if (!walk_listing || !walk_found || !request_queue || !batch_queue) {
+        ESP_LOGE(TAG, "Failed to allocate discovery state");
+        return ESP_ERR_NO_MEM;
+    }
+    psram_arena_init(&walk_paths, PATH_ARENA_CHUNK);
+
+    // Same core as the flash task, away from LVGL on CPU0
+    if (xTaskCreatePinnedToCore(discovery_task, "fw_discovery", DISCOVERY_TASK_STACK, NULL,
+                                DISCOVERY_TASK_PRIORITY, &discovery_task_handle, 1) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create discovery task");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t firmware_discovery_start(const char *root, int max_depth) {
+    if (!discovery_task_handle) {
+        esp_err_t ret = start_task();
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    discovery_request_t request = {
+        .max_depth = max_depth,
+        .generation = atomic_fetch_add(&current_generation, 1) + 1,
+    };
+    strncpy(request.root, root, sizeof(request.root) - 1);
+    discard_batches();
+    xQueueOverwrite(request_queue, &request);
+    return ESP_OK;
+}
+
+void firmware_discovery_cancel(void) {
+    atomic_fetch_add(&current_generation, 1);
+    if (batch_queue) {
+        discard_batches();
+    }
+}
+
+size_t firmware_discovery_poll(firmware_list_t *list, bool *done) {
+    *done = false;
+    if (!batch_queue) {
+        return 0;
+    }
+
+    size_t added = 0;
+    unsigned generation = atomic_load(&current_generation);
+    discovery_batch_t batch;
+    while (xQueueReceive(batch_queue, &batch, 0) == pdTRUE) {
+        if (batch.generation == generation) {
+            size_t count = firmware_list_count(batch.files);
+            for (size_t i = 0; i < count; i++) {
+                if (firmware_list_add(list, firmware_list_get(batch.files, i)) == ESP_OK) {
+                    added++;
+                }
+            }
+            *done = batch.done;
+        }
+        firmware_list_destroy(batch.files);
+    }
+    return added;
+}
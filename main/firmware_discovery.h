@@ -0,0 +1,34 @@
+#ifndef FIRMWARE_DISCOVERY_H
+#define FIRMWARE_DISCOVERY_H
+
+#include "esp_err.h"
+#include "firmware_list.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define FIRMWARE_DISCOVERY_BATCH_SIZE 16    // Files per batch handed to the UI
+
+/**
+ * @brief Start looking for firmware files in the background
+ * Directories are walked breadth first, so files closer to the root arrive
+ * first. A walk already running is cancelled.
+ * @param root Directory to start from (relative to SD root)
+ * @param max_depth Subdirectory levels below root to visit, 0 for root only
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t firmware_discovery_start(const char *root, int max_depth);
+
+/**
+ * @brief Stop the running walk, its pending results are dropped
+ */
+void firmware_discovery_cancel(void);
+
+/**
+ * @brief Take the results found since the last call, without blocking
+ * @param list Files of the current walk are appended to it
+ * @param done Output, true once the walk finished and everything was delivered
+ * @return Number of files appended
+ */
+size_t firmware_discovery_poll(firmware_list_t *list, bool *done);
+
+#endif // FIRMWARE_DISCOVERY_H
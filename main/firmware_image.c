@@ -0,0 +1,169 @@
+#include "firmware_image.h"
+#include "esp_log.h"
+#include "esp_app_format.h"
+#include "esp_image_format.h"
+#include "esp_app_desc.h"
+#include "hal/efuse_hal.h"
+#include "sdkconfig.h"
+#include <string.h>
+#include <stdio.h>
+
+static const char *TAG = "FIRMWARE_IMAGE";
+
+#define CHIP_REV_ANY 0xFFFF        // Revision field left unset by the build
+
+static const struct {
+    uint16_t id;
+    const char *name;
+} chip_names[] = {
+    { ESP_CHIP_ID_ESP32, "ESP32" },
+    { ESP_CHIP_ID_ESP32S2, "ESP32-S2" },
+    { ESP_CHIP_ID_ESP32C3, "ESP32-C3" },
+    { ESP_CHIP_ID_ESP32S3, "ESP32-S3" },
+    { ESP_CHIP_ID_ESP32C2, "ESP32-C2" },
+    { ESP_CHIP_ID_ESP32C6, "ESP32-C6" },
+    { ESP_CHIP_ID_ESP32H2, "ESP32-H2" },
+    { ESP_CHIP_ID_ESP32P4, "ESP32-P4" },
+    { ESP_CHIP_ID_ESP32C5, "ESP32-C5" },
+    { ESP_CHIP_ID_ESP32C61, "ESP32-C61" },
+};
+
+static void copy_field(char *dest, const char *src, size_t size) {
+    // Descriptor strings are fixed-size arrays, not always terminated
+    memcpy(dest, src, size - 1);
+    dest[size - 1] = '\0';
+}
+
+static esp_err_t read_exact(firmware_source_t *src, void *buf, size_t len) {
+    size_t got = 0;
+    esp_err_t ret = firmware_source_read(src, buf, len, &got);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return got == len ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+static esp_err_t parse_image(firmware_source_t *src, firmware_image_info_t *info) {
+    esp_image_header_t header;
+    esp_err_t ret = read_exact(src, &header, sizeof(header));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (header.magic != ESP_IMAGE_HEADER_MAGIC) {
+        ESP_LOGD(TAG, "Invalid firmware magic: 0x%02x", header.magic);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (header.segment_count == 0 || header.segment_count > ESP_IMAGE_MAX_SEGMENTS) {
+        ESP_LOGD(TAG, "Invalid segment count: %u", header.segment_count);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    info->chip_id = header.chip_id;
+    info->min_chip_rev = header.min_chip_rev_full;
+    info->max_chip_rev = header.max_chip_rev_full;
+    info->segment_count = header.segment_count;
+    info->hash_appended = header.hash_appended == 1;
+
+    // The app descriptor opens the first segment
+    esp_image_segment_header_t segment;
+    ret = read_exact(src, &segment, sizeof(segment));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    size_t consumed = 0;
+    if (segment.data_len >= sizeof(esp_app_desc_t)) {
+        esp_app_desc_t desc;
+        ret = read_exact(src, &desc, sizeof(desc));
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        consumed = sizeof(desc);
+        if (desc.magic_word == ESP_APP_DESC_MAGIC_WORD) {
+            info->has_app_desc = true;
+            copy_field(info->project_name, desc.project_name, sizeof(info->project_name));
+            copy_field(info->version, desc.version, sizeof(info->version));
+            copy_field(info->idf_version, desc.idf_ver, sizeof(info->idf_version));
+            copy_field(info->build_date, desc.date, sizeof(info->build_date));
+            copy_field(info->build_time, desc.time, sizeof(info->build_time));
+        }
+    }
+
+    // Walk the segment table with seeks, a truncated image fails here
+    size_t pos = sizeof(header) + sizeof(segment) + segment.data_len;
+    for (uint8_t i = 1; i <= header.segment_count; i++) {
+        ret = firmware_source_skip(src, segment.data_len - consumed);
+        if (ret == ESP_ERR_NOT_SUPPORTED) {
+            return ESP_OK;
+        }
+        if (ret != ESP_OK) {
+            ESP_LOGD(TAG, "Segment %u runs past the end of the image", i - 1);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        if (i == header.segment_count) {
+            break;
+        }
+        ret = read_exact(src, &segment, sizeof(segment));
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        pos += sizeof(segment) + segment.data_len;
+        consumed = 0;
+    }
+    info->segments_checked = true;
+
+    // The hash follows the checksum byte and the padding to 16 bytes. Signed
+    // images carry their signature block behind it, so it is not at the end.
+    if (info->hash_appended) {
+        pos = (pos + 1 + 15) & ~(size_t)15;
+        if (pos + ESP_IMAGE_HASH_LEN > firmware_source_image_size(src)) {
+            ESP_LOGD(TAG, "Appended hash runs past the end of the image");
+            return ESP_ERR_INVALID_SIZE;
+        }
+        info->hash_offset = pos;
+    }
+    return ESP_OK;
+}
+
+esp_err_t firmware_image_parse(firmware_source_t *src, firmware_image_info_t *info) {
+    memset(info, 0, sizeof(*info));
+    esp_err_t ret = parse_image(src, info);
+    esp_err_t rewind_ret = firmware_source_rewind(src);
+    return ret != ESP_OK ? ret : rewind_ret;
+}
+
+esp_err_t firmware_image_check_chip(const firmware_image_info_t *info, char *reason, size_t reason_size) {
+    if (info->chip_id != CONFIG_IDF_FIRMWARE_CHIP_ID) {
+        if (reason) {
+            snprintf(reason, reason_size, "Built for %s, this is %s", firmware_image_chip_name(info->chip_id),
+                     firmware_image_chip_name(CONFIG_IDF_FIRMWARE_CHIP_ID));
+        }
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    // Same check the bootloader does, better to fail before erasing anything.
+    // Like it, treat 0xFFFF as "any" for the minimum and 0 or 0xFFFF as unset for the maximum.
+    unsigned revision = efuse_hal_chip_revision();
+    bool min_ok = info->min_chip_rev == CHIP_REV_ANY || revision >= info->min_chip_rev;
+    bool max_set = info->max_chip_rev != 0 && info->max_chip_rev != CHIP_REV_ANY;
+    if (!min_ok || (max_set && revision > info->max_chip_rev)) {
+        if (reason && max_set) {
+            snprintf(reason, reason_size, "Supports chip v%u.%u to v%u.%u, this is v%u.%u",
+                     info->min_chip_rev / 100, info->min_chip_rev % 100,
+                     info->max_chip_rev / 100, info->max_chip_rev % 100, revision / 100, revision % 100);
+        } else if (reason) {
+            snprintf(reason, reason_size, "Needs chip v%u.%u or newer, this is v%u.%u",
+                     info->min_chip_rev / 100, info->min_chip_rev % 100, revision / 100, revision % 100);
+        }
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return ESP_OK;
+}
+
+const char *firmware_image_chip_name(uint16_t chip_id) {
+    for (size_t i = 0; i < sizeof(chip_names) / sizeof(chip_names[0]); i++) {
+        if (chip_names[i].id == chip_id) {
+            return chip_names[i].name;
+        }
+    }
+    return "unknown";
+}
@@ -0,0 +1,58 @@
+#ifndef FIRMWARE_IMAGE_H
+#define FIRMWARE_IMAGE_H
+
+#include "esp_err.h"
+#include "firmware_source.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Metadata of an app image, from its header, segment table and app descriptor
+typedef struct {
+    uint16_t chip_id;                       // esp_chip_id_t the image was built for
+    uint16_t min_chip_rev;                  // Oldest supported chip revision, major * 100 + minor, 0xFFFF for any
+    uint16_t max_chip_rev;                  // Newest supported chip revision, 0 or 0xFFFF if unbounded
+    uint8_t segment_count;
+    bool segments_checked;                  // Every segment was walked, only for uncompressed images
+    bool hash_appended;                     // The image ends with its SHA-256
+    uint32_t hash_offset;                   // Where the appended SHA-256 sits, 0 if absent or not reached
+    bool has_app_desc;                      // The fields below are valid
+    char project_name[32];
+    char version[32];
+    char idf_version[32];
+    char build_date[16];
+    char build_time[16];
+} firmware_image_info_t;
+
+/**
+ * @brief Read the metadata of an app image
+ * Reads the image header, the first segment header and the app descriptor
+ * behind it. On uncompressed images the remaining segment headers are
+ * visited with seeks, which checks that every segment fits in the file and
+ * locates the appended hash. Compressed images would have to be inflated
+ * completely to reach them.
+ * The source is rewound afterwards.
+ * @param src Source positioned at the start of the image
+ * @param info Output
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if this is not an app image,
+ *         ESP_ERR_INVALID_SIZE if it is truncated
+ */
+esp_err_t firmware_image_parse(firmware_source_t *src, firmware_image_info_t *info);
+
+/**
+ * @brief Check if an image can run on this chip
+ * @param info Parsed image
+ * @param reason Output, why it cannot run, may be NULL
+ * @param reason_size Size of reason
+ * @return ESP_OK if it can, ESP_ERR_NOT_SUPPORTED if it was built for another chip or revision
+ */
+esp_err_t firmware_image_check_chip(const firmware_image_info_t *info, char *reason, size_t reason_size);
+
+/**
+ * @brief Get a readable chip name
+ * @param chip_id esp_chip_id_t value
+ * @return Name such as "ESP32-P4", "unknown" for IDs not known to this build
+ */
+const char *firmware_image_chip_name(uint16_t chip_id);
+
+#endif // FIRMWARE_IMAGE_H
@@ -0,0 +1,86 @@
+#include "firmware_list.h"
+#include "psram_arena.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+
+#define STRING_ARENA_CHUNK (16 * 1024)
+#define INITIAL_CAPACITY   32
+
+struct firmware_list {
+    firmware_info_t *entries;       // PSRAM array, grows by doubling
+    size_t count;
+    size_t capacity;
+    psram_arena_t strings;          // File names and paths
+};
+
+firmware_list_t *firmware_list_create(void) {
+    firmware_list_t *list = heap_caps_calloc(1, sizeof(*list), MALLOC_CAP_SPIRAM);
+    if (!list) {
+        list = heap_caps_calloc(1, sizeof(*list), MALLOC_CAP_DEFAULT);
+    }
+    if (list) {
+        psram_arena_init(&list->strings, STRING_ARENA_CHUNK);
+    }
+    return list;
+}
+
+void firmware_list_destroy(firmware_list_t *list) {
+    if (!list) {
+        return;
+    }
+    psram_arena_destroy(&list->strings);
+    heap_caps_free(list->entries);
+    heap_caps_free(list);
+}
+
+void firmware_list_clear(firmware_list_t *list) {
+    list->count = 0;
+    psram_arena_reset(&list->strings);
+}
+
+esp_err_t firmware_list_add(firmware_list_t *list, const firmware_info_t *info) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : INITIAL_CAPACITY;
+        firmware_info_t *entries = heap_caps_realloc(list->entries, capacity * sizeof(firmware_info_t), MALLOC_CAP_SPIRAM);
+        if (!entries) {
+            return ESP_ERR_NO_MEM;
+        }
+        list->entries = entries;
+        list->capacity = capacity;
+    }
+
+    firmware_info_t copy = *info;
+    copy.filename = psram_arena_strdup(&list->strings, info->filename);
+    copy.full_path = psram_arena_strdup(&list->strings, info->full_path);
+    copy.project_name = psram_arena_strdup(&list->strings, info->project_name ? info->project_name : "");
+    copy.version = psram_arena_strdup(&list->strings, info->version ? info->version : "");
+    copy.idf_version = psram_arena_strdup(&list->strings, info->idf_version ? info->idf_version : "");
+    copy.build_date = psram_arena_strdup(&list->strings, info->build_date ? info->build_date : "");
+    if (!copy.filename || !copy.full_path || !copy.project_name || !copy.version ||
+        !copy.idf_version || !copy.build_date) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    list->entries[list->count++] = copy;
+    return ESP_OK;
+}
+
+size_t firmware_list_count(const firmware_list_t *list) {
+    return list ? list->count : 0;
+}
+
+const firmware_info_t *firmware_list_get(const firmware_list_t *list, size_t index) {
+    if (!list || index >= list->count) {
+        return NULL;
+    }
+    return &list->entries[index];
+}
+
+size_t firmware_list_page(const firmware_list_t *list, size_t first, size_t max, const firmware_info_t **page) {
+    if (!list || first >= list->count) {
+        *page = NULL;
+        return 0;
+    }
+    *page = &list->entries[first];
+    return (list->count - first < max) ? list->count - first : max;
+}
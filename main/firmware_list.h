@@ -0,0 +1,76 @@
+#ifndef FIRMWARE_LIST_H
+#define FIRMWARE_LIST_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    const char *filename;   // Interned in the list, valid until it is cleared
+    const char *full_path;  // Path relative to SD root, interned as well
+    size_t size;            // Size of the file on the SD card
+    size_t image_size;      // Size once decompressed, equal to size for plain .bin files
+    const char *project_name;   // From the app descriptor, empty if the image has none
+    const char *version;        // From the app descriptor, empty if the image has none
+    const char *idf_version;    // From the app descriptor, empty if the image has none
+    const char *build_date;     // From the app descriptor, empty if the image has none
+    uint16_t chip_id;           // Chip the image was built for, from the image header
+    bool compatible;            // Can run on this chip, false images are listed but not flashed
+} firmware_info_t;
+
+// Firmware files found on the card, any number of them, kept in PSRAM
+typedef struct firmware_list firmware_list_t;
+
+/**
+ * @brief Create an empty firmware list
+ * @return List, NULL if out of memory
+ */
+firmware_list_t *firmware_list_create(void);
+
+/**
+ * @brief Free a firmware list
+ * @param list List, may be NULL
+ */
+void firmware_list_destroy(firmware_list_t *list);
+
+/**
+ * @brief Remove all entries, keeping the memory for the next scan
+ * @param list List
+ */
+void firmware_list_clear(firmware_list_t *list);
+
+/**
+ * @brief Append a firmware file
+ * @param list List
+ * @param info Entry to append, its strings are copied into the list
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t firmware_list_add(firmware_list_t *list, const firmware_info_t *info);
+
+/**
+ * @brief Get the number of firmware files
+ * @param list List
+ * @return Entry count
+ */
+size_t firmware_list_count(const firmware_list_t *list);
+
+/**
+ * @brief Get one firmware file
+ * @param list List
+ * @param index Entry index
+ * @return Entry, NULL if index is out of range. Valid until the list changes.
+ */
+const firmware_info_t *firmware_list_get(const firmware_list_t *list, size_t index);
+
+/**
+ * @brief Get a page of consecutive firmware files
+ * @param list List
+ * @param first Index of the first entry of the page
+ * @param max Page size
+ * @param page Output, first entry of the page. Valid until the list changes.
+ * @return Number of entries in the page, 0 once first is past the end
+ */
+size_t firmware_list_page(const firmware_list_t *list, size_t first, size_t max, const firmware_info_t **page);
+
+#endif // FIRMWARE_LIST_H
@@ -2,25 +2,44 @@
 #define FIRMWARE_LOADER_H
 
 #include "esp_err.h"
+#include "firmware_list.h"
+#include "sd_listing.h"
 #include <stdint.h>
 #include <stdbool.h>
 
 #define MAX_FIRMWARE_NAME_LEN 64
 #define MAX_FIRMWARE_PATH_LEN 256
 
-typedef struct {
-    char filename[MAX_FIRMWARE_NAME_LEN];
-    char full_path[MAX_FIRMWARE_PATH_LEN];
-    size_t size;
-} firmware_info_t;
+// Flashing steps reported through the progress callback, see firmware_loader_step_description()
+typedef enum {
+    FIRMWARE_STEP_IDLE = 0,
+    FIRMWARE_STEP_ALREADY_INSTALLED,
+    FIRMWARE_STEP_BOOTING_INSTALLED,
+    FIRMWARE_STEP_RESUMING,
+    FIRMWARE_STEP_STARTING,
+    FIRMWARE_STEP_WRITING,
+    FIRMWARE_STEP_FINALIZING,
+    FIRMWARE_STEP_COMPLETE,
+    FIRMWARE_STEP_FAILED,
+    FIRMWARE_STEP_WRONG_CHIP,
+    FIRMWARE_STEP_COUNT
+} firmware_step_t;
 
 /**
  * @brief Progress callback function type
+ * Called from the flashing task, possibly once per chunk, so it must be cheap.
  * @param bytes_written Number of bytes written so far
  * @param total_bytes Total number of bytes to write
- * @param step_description Current step description
+ * @param step Current step
  */
-typedef void (*firmware_progress_callback_t)(size_t bytes_written, size_t total_bytes, const char *step_description);
+typedef void (*firmware_progress_callback_t)(size_t bytes_written, size_t total_bytes, firmware_step_t step);
+
+/**
+ * @brief Get the user-facing text for a flashing step
+ * @param step Step reported through the progress callback
+ * @return Static string, never NULL
+ */
+const char *firmware_loader_step_description(firmware_step_t step);
 
 /**
  * @brief Initialize firmware loader
@@ -43,29 +62,51 @@ esp_err_t firmware_loader_flash_from_sd(const char *firmware_path);
 
 /**
  * @brief Flash firmware from SD card with progress callback
+ * The image goes into an empty slot, or replaces the least recently used one.
+ * If the file is already resident nothing is written and its slot becomes the
+ * most recently used, i.e. the one firmware_loader_boot_firmware_once() boots.
  * @param firmware_path Path to firmware file on SD card
  * @param progress_callback Callback function for progress updates
- * @return ESP_OK on success, error code otherwise
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if the image is built for
+ *         another chip or revision, error code otherwise
  */
 esp_err_t firmware_loader_flash_from_sd_with_progress(const char *firmware_path, firmware_progress_callback_t progress_callback);
 
 /**
  * @brief Check if a firmware is installed and ready to boot
- * @return true if firmware is ready, false otherwise
+ * @return true if any slot holds a firmware, false otherwise
  */
 bool firmware_loader_is_firmware_ready(void);
 
 /**
- * @brief Scan directory for firmware files
- * @param directory Directory to scan
- * @param firmware_list Array to store firmware info
- * @param max_count Maximum number of firmware files to return
+ * @brief Check if a firmware file is identical to the installed firmware
+ * Compares the SHA-256 digest of the file with the digests recorded for each
+ * firmware slot. The file digest is cached and slot digests live in NVS, so
+ * repeated checks do not touch the card or flash.
+ * @param firmware_path Path to firmware file on SD card
+ * @return true if the file is already installed, false otherwise
+ */
+bool firmware_loader_is_installed(const char *firmware_path);
+
+/**
+ * @brief Find the firmware slot already holding a firmware file
+ * @param firmware_path Path to firmware file on SD card
+ * @return Slot index, -1 if the file is not installed
+ */
+int firmware_loader_installed_slot(const char *firmware_path);
+
+/**
+ * @brief Find the firmware files of a directory that was already listed
+ * @param directory Directory the listing is of
+ * @param listing Entries of the directory
+ * @param firmware_list Cleared, then filled with every firmware file in the listing
  * @return Number of firmware files found
  */
-int firmware_loader_scan_firmware_files(const char *directory, firmware_info_t *firmware_list, int max_count);
+int firmware_loader_scan_listing(const char *directory, const sd_listing_t *listing, firmware_list_t *firmware_list);
 
 /**
  * @brief Boot firmware once without changing default boot partition
+ * Boots the most recently used firmware slot.
  * This uses OTA rollback mechanism to ensure launcher remains default
  * @return ESP_OK (never returns)
  */
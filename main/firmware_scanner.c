@@ -1,75 +1,106 @@
 #include "firmware_loader.h"
+#include "firmware_catalog.h"
 #include "sd_manager.h"
+#include "firmware_source.h"
+#include "firmware_image.h"
 #include "esp_log.h"
 #include <string.h>
 #include <stdio.h>
-#include <sys/stat.h>
 
 static const char *TAG = "FIRMWARE_SCANNER";
 
-static bool is_firmware_file(const char *filename) {
-    size_t len = strlen(filename);
-    if (len < 4) return false;
-    return (strcmp(&filename[len-4], ".bin") == 0);
+static bool build_path(const char *directory, const char *name, char *full_path, size_t size) {
+    size_t dir_len = strlen(directory);
+    bool has_slash = dir_len > 0 && directory[dir_len - 1] == '/';
+    int len = snprintf(full_path, size, "%s%s%s", directory, has_slash ? "" : "/", name);
+    return len >= 0 && len < (int)size;
 }
 
-int firmware_loader_scan_firmware_files(const char *directory, firmware_info_t *firmware_list, int max_count) {
-    if (!sd_manager_is_mounted()) {
-        ESP_LOGW(TAG, "SD card not mounted");
-        return 0;
+static void probe_image(const char *path, const file_entry_t *file, firmware_catalog_entry_t *entry) {
+    memset(entry, 0, sizeof(*entry));
+    entry->path = path;
+    entry->size = file->size;
+    entry->image_size = file->size;
+    entry->mtime = file->mtime;
+
+    firmware_source_t *src;
+    if (firmware_source_open(path, &src) != ESP_OK) {
+        return;
+    }
+    entry->image_size = firmware_source_image_size(src);
+    entry->has_image = firmware_image_parse(src, &entry->image) == ESP_OK;
+    firmware_source_close(src);
+    if (!entry->has_image) {
+        ESP_LOGW(TAG, "Not an app image: %s", path);
+        return;
+    }
+
+    // Only cheap digests: hashing a whole file here would make the first scan as slow as a flash
+    if (entry->image.hash_appended && firmware_digest_of_file(path, entry->digest) == ESP_OK) {
+        entry->has_digest = true;
+    }
+}
+
+static void update_catalog(const char *directory, const sd_listing_t *listing, uint32_t image_count, uint32_t signature) {
+    if (firmware_catalog_begin(directory) != ESP_OK) {
+        ESP_LOGW(TAG, "Out of memory, firmware catalog not updated");
+        return;
+    }
+
+    int probed = 0;
+    size_t count = sd_listing_count(listing);
+    for (size_t i = 0; i < count; i++) {
+        const file_entry_t *file = sd_listing_get(listing, i);
+        if (file->is_directory || !firmware_source_is_image_file(file->name)) {
+            continue;
+        }
+
+        char full_path[MAX_FIRMWARE_PATH_LEN];
+        if (!build_path(directory, file->name, full_path, sizeof(full_path))) {
+            ESP_LOGW(TAG, "Path too long, skipping: %s/%s", directory, file->name);
+            continue;
+        }
+
+        // Unchanged files keep what was learned about them
+        const firmware_catalog_entry_t *known = firmware_catalog_lookup(full_path, file->size, file->mtime);
+        firmware_catalog_entry_t entry;
+        if (!known) {
+            probe_image(full_path, file, &entry);
+            known = &entry;
+            probed++;
+        }
+        if (firmware_catalog_add(known) != ESP_OK) {
+            ESP_LOGW(TAG, "Out of memory, firmware catalog truncated");
+            break;
+        }
+    }
+
+    firmware_catalog_end(image_count, signature);
+    ESP_LOGI(TAG, "Catalog of %s updated, %d of %u images probed", directory, probed, (unsigned)image_count);
+}
+
+int firmware_loader_scan_listing(const char *directory, const sd_listing_t *listing, firmware_list_t *firmware_list) {
+    // Already checked against the card, nothing to compare
+    if (firmware_catalog_fill(directory, firmware_list)) {
+        return (int)firmware_list_count(firmware_list);
     }
     
-    file_entry_t entries[32];
-    int entry_count = sd_manager_scan_directory(directory, entries, 32);
-    int firmware_count = 0;
-    
-    for (int i = 0; i < entry_count && firmware_count < max_count; i++) {
-        if (!entries[i].is_directory && is_firmware_file(entries[i].name)) {
-            // Copy filename with bounds checking
-            strncpy(firmware_list[firmware_count].filename, entries[i].name, MAX_FIRMWARE_NAME_LEN - 1);
-            firmware_list[firmware_count].filename[MAX_FIRMWARE_NAME_LEN - 1] = '\0';
-            
-            // Build full path with explicit bounds checking
-            size_t dir_len = strlen(directory);
-            size_t name_len = strlen(entries[i].name);
-            
-            // Check if the combined path will fit (directory + "/" + filename + null terminator)
-            if (dir_len + 1 + name_len + 1 <= MAX_FIRMWARE_PATH_LEN) {
-                // Use explicit string operations to avoid compiler warnings
-                strcpy(firmware_list[firmware_count].full_path, directory);
-                strcat(firmware_list[firmware_count].full_path, "/");
-                strcat(firmware_list[firmware_count].full_path, entries[i].name);
-            } else {
-                ESP_LOGW(TAG, "Path too long, skipping: %.*s/%.*s", 
-                        (int)dir_len, directory, (int)name_len, entries[i].name);
-                continue;
-            }
-            
-            // Get file size - build SD card path with explicit bounds checking
-            size_t sd_prefix_len = 8; // "/sdcard" length
-            if (sd_prefix_len + dir_len + 1 + name_len + 1 <= 512) {
-                char full_sd_path[512];
-                strcpy(full_sd_path, "/sdcard");
-                strcat(full_sd_path, directory);
-                strcat(full_sd_path, "/");
-                strcat(full_sd_path, entries[i].name);
-                
-                struct stat file_stat;
-                if (stat(full_sd_path, &file_stat) == 0) {
-                    firmware_list[firmware_count].size = file_stat.st_size;
-                } else {
-                    firmware_list[firmware_count].size = 0;
-                }
-            } else {
-                ESP_LOGW(TAG, "SD path too long, setting size to 0: %.*s/%.*s", 
-                        (int)dir_len, directory, (int)name_len, entries[i].name);
-                firmware_list[firmware_count].size = 0;
-            }
-            
-            firmware_count++;
+    size_t entry_count = sd_listing_count(listing);
+    uint32_t image_count = 0;
+    uint32_t signature = 0;
+    for (size_t i = 0; i < entry_count; i++) {
+        const file_entry_t *file = sd_listing_get(listing, i);
+        if (!file->is_directory && firmware_source_is_image_file(file->name)) {
+            signature = firmware_catalog_signature(signature, file->name, file->size, file->mtime);
+            image_count++;
         }
     }
     
-    ESP_LOGI(TAG, "Found %d firmware files in %s", firmware_count, directory);
-    return firmware_count;
-}
\ No newline at end of file
+    if (!firmware_catalog_validate(directory, image_count, signature)) {
+        update_catalog(directory, listing, image_count, signature);
+    }
+    if (!firmware_catalog_fill(directory, firmware_list)) {
+        firmware_list_clear(firmware_list);
+    }
+    return (int)firmware_list_count(firmware_list);
+}
@@ -0,0 +1,279 @@
+#include "firmware_slots.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_app_format.h"
+#include "nvs.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+static const char *TAG = "FIRMWARE_SLOTS";
+static const char *NVS_NAMESPACE = "launcher";
+static const char *NVS_KEY_SLOT_CLOCK = "slot_clock";
+
+// Layout of a slot's NVS blob, kept separate from firmware_slot_t so the
+// in-memory struct can change without breaking stored records
+typedef struct {
+    uint32_t address;                       // Partition the record was written for
+    uint8_t occupied;
+    char name[MAX_FIRMWARE_NAME_LEN];
+    char version[FIRMWARE_SLOT_VERSION_LEN];
+    uint8_t digest[FIRMWARE_DIGEST_LEN];
+    uint32_t last_used;
+} slot_record_t;
+
+static firmware_slot_t slots[FIRMWARE_SLOT_MAX];
+static int slot_count = 0;
+// There is no wall clock before the firmware sets one, so recency is a persisted counter
+static uint32_t slot_clock = 0;
+
+static void slot_key(int index, char *key, size_t key_len) {
+    snprintf(key, key_len, "slot%d", index);
+}
+
+static bool partition_has_image(const esp_partition_t *partition) {
+    esp_image_header_t header;
+    if (esp_partition_read(partition, 0, &header, sizeof(header)) != ESP_OK) {
+        return false;
+    }
+    return header.magic == ESP_IMAGE_HEADER_MAGIC;
+}
+
+static void read_version(const esp_partition_t *partition, char *version) {
+    esp_app_desc_t desc;
+    if (esp_ota_get_partition_description(partition, &desc) == ESP_OK) {
+        strncpy(version, desc.version, FIRMWARE_SLOT_VERSION_LEN - 1);
+        version[FIRMWARE_SLOT_VERSION_LEN - 1] = '\0';
+    } else {
+        version[0] = '\0';
+    }
+}
+
+static esp_err_t save_slot(int index) {
+    nvs_handle_t nvs_handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    const firmware_slot_t *slot = &slots[index];
+    slot_record_t record = {
+        .address = slot->partition->address,
+        .occupied = slot->occupied,
+        .last_used = slot->last_used,
+    };
+    memcpy(record.name, slot->name, sizeof(record.name));
+    memcpy(record.version, slot->version, sizeof(record.version));
+    memcpy(record.digest, slot->digest, sizeof(record.digest));
+
+    char key[16];
+    slot_key(index, key, sizeof(key));
+    ret = nvs_set_blob(nvs_handle, key, &record, sizeof(record));
+    if (ret == ESP_OK) {
+        ret = nvs_set_u32(nvs_handle, NVS_KEY_SLOT_CLOCK, slot_clock);
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save slot %d: %s", index, esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+// An image that is in flash but has no record, e.g. flashed before slots existed
+static void adopt_slot(int index) {
+    firmware_slot_t *slot = &slots[index];
+    if (firmware_digest_of_partition(slot->partition, slot->digest) != ESP_OK) {
+        return;
+    }
+    slot->occupied = true;
+    strcpy(slot->name, "Unknown");
+    read_version(slot->partition, slot->version);
+    slot->last_used = 0;
+    ESP_LOGI(TAG, "Adopted existing image in %s (%s)", slot->partition->label, slot->version);
+    save_slot(index);
+}
+
+esp_err_t firmware_slots_init(void) {
+    memset(slots, 0, sizeof(slots));
+    slot_count = 0;
+
+    for (int i = 0; i < FIRMWARE_SLOT_MAX; i++) {
+        const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_APP,
+                                                                    (esp_partition_subtype_t)(ESP_PARTITION_SUBTYPE_APP_OTA_MIN + i), NULL);
+        if (!partition) {
+            break;
+        }
+        slots[slot_count++].partition = partition;
+    }
+
+    if (slot_count == 0) {
+        ESP_LOGE(TAG, "No OTA partitions found");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    nvs_handle_t nvs_handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    nvs_get_u32(nvs_handle, NVS_KEY_SLOT_CLOCK, &slot_clock);
+
+    bool adopt[FIRMWARE_SLOT_MAX] = {0};
+    for (int i = 0; i < slot_count; i++) {
+        firmware_slot_t *slot = &slots[i];
+        slot_record_t record;
+        size_t record_size = sizeof(record);
+        char key[16];
+        slot_key(i, key, sizeof(key));
+
+        bool has_image = partition_has_image(slot->partition);
+        ret = nvs_get_blob(nvs_handle, key, &record, &record_size);
+        // Records from an older partition layout describe another partition, the image is adopted again
+        if (ret == ESP_OK && record_size == sizeof(record) && record.address == slot->partition->address &&
+            record.occupied) {
+            if (has_image) {
+                slot->occupied = true;
+                memcpy(slot->name, record.name, sizeof(slot->name));
+                memcpy(slot->version, record.version, sizeof(slot->version));
+                memcpy(slot->digest, record.digest, sizeof(slot->digest));
+                slot->name[sizeof(slot->name) - 1] = '\0';
+                slot->version[sizeof(slot->version) - 1] = '\0';
+                slot->last_used = record.last_used;
+            } else {
+                ESP_LOGW(TAG, "Slot %d lost its image, marking empty", i);
+                nvs_erase_key(nvs_handle, key);
+            }
+        } else if (has_image) {
+            adopt[i] = true;
+        }
+    }
+    nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+
+    for (int i = 0; i < slot_count; i++) {
+        if (adopt[i]) {
+            adopt_slot(i);
+        }
+        ESP_LOGI(TAG, "Slot %d: %s @ 0x%" PRIx32 " (%" PRIu32 " KB) %s %s", i, slots[i].partition->label,
+                 slots[i].partition->address, slots[i].partition->size / 1024,
+                 slots[i].occupied ? slots[i].name : "<empty>", slots[i].version);
+    }
+    return ESP_OK;
+}
+
+int firmware_slots_count(void) {
+    return slot_count;
+}
+
+const firmware_slot_t *firmware_slots_get(int index) {
+    if (index < 0 || index >= slot_count) {
+        return NULL;
+    }
+    return &slots[index];
+}
+
+int firmware_slots_index_of(const esp_partition_t *partition) {
+    for (int i = 0; i < slot_count; i++) {
+        if (slots[i].partition == partition) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int firmware_slots_find(const uint8_t *digest) {
+    for (int i = 0; i < slot_count; i++) {
+        if (slots[i].occupied && memcmp(slots[i].digest, digest, FIRMWARE_DIGEST_LEN) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int firmware_slots_select(size_t image_size) {
+    int best = -1;
+
+    // Smallest empty slot that fits, so large slots stay free for large images
+    for (int i = 0; i < slot_count; i++) {
+        if (!slots[i].occupied && slots[i].partition->size >= image_size &&
+            (best < 0 || slots[i].partition->size < slots[best].partition->size)) {
+            best = i;
+        }
+    }
+    if (best >= 0) {
+        return best;
+    }
+
+    // Otherwise evict the least recently used image that leaves enough room
+    for (int i = 0; i < slot_count; i++) {
+        if (slots[i].partition->size >= image_size &&
+            (best < 0 || slots[i].last_used < slots[best].last_used)) {
+            best = i;
+        }
+    }
+    if (best >= 0) {
+        ESP_LOGI(TAG, "Evicting %s from slot %d", slots[best].name, best);
+    }
+    return best;
+}
+
+int firmware_slots_most_recent(void) {
+    int best = -1;
+    for (int i = 0; i < slot_count; i++) {
+        if (slots[i].occupied && (best < 0 || slots[i].last_used > slots[best].last_used)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+esp_err_t firmware_slots_release(int index) {
+    if (index < 0 || index >= slot_count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!slots[index].occupied) {
+        return ESP_OK;
+    }
+
+    firmware_slot_t *slot = &slots[index];
+    slot->occupied = false;
+    slot->name[0] = '\0';
+    slot->version[0] = '\0';
+    memset(slot->digest, 0, sizeof(slot->digest));
+    return save_slot(index);
+}
+
+esp_err_t firmware_slots_record(int index, const char *name, const uint8_t *digest) {
+    if (index < 0 || index >= slot_count || !name || !digest) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    firmware_slot_t *slot = &slots[index];
+    slot->occupied = true;
+    strncpy(slot->name, name, sizeof(slot->name) - 1);
+    slot->name[sizeof(slot->name) - 1] = '\0';
+    read_version(slot->partition, slot->version);
+    memcpy(slot->digest, digest, FIRMWARE_DIGEST_LEN);
+    slot->last_used = ++slot_clock;
+
+    ESP_LOGI(TAG, "Slot %d now holds %s (%s)", index, slot->name, slot->version);
+    return save_slot(index);
+}
+
+esp_err_t firmware_slots_touch(int index) {
+    if (index < 0 || index >= slot_count || !slots[index].occupied) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (slots[index].last_used == slot_clock && slot_clock != 0) {
+        return ESP_OK;
+    }
+    slots[index].last_used = ++slot_clock;
+    return save_slot(index);
+}
@@ -0,0 +1,97 @@
+#ifndef FIRMWARE_SLOTS_H
+#define FIRMWARE_SLOTS_H
+
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "firmware_loader.h"
+#include "firmware_digest.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FIRMWARE_SLOT_MAX         4
+#define FIRMWARE_SLOT_VERSION_LEN 32
+
+typedef struct {
+    const esp_partition_t *partition;       // OTA app partition backing the slot
+    bool occupied;                          // Holds a complete, recorded image
+    char name[MAX_FIRMWARE_NAME_LEN];       // File name the image was flashed from
+    char version[FIRMWARE_SLOT_VERSION_LEN];// Version from the image's app description
+    uint8_t digest[FIRMWARE_DIGEST_LEN];    // Key of the file, see firmware_digest_key_of_file()
+    uint32_t last_used;                     // Use counter value, higher is more recent
+} firmware_slot_t;
+
+/**
+ * @brief Discover the OTA slots and load their metadata from NVS
+ * Slots whose partition no longer holds an image are reset to empty.
+ * NVS must be initialized first.
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if there are no OTA partitions
+ */
+esp_err_t firmware_slots_init(void);
+
+/**
+ * @brief Get the number of OTA slots
+ * @return Slot count
+ */
+int firmware_slots_count(void);
+
+/**
+ * @brief Get a slot
+ * @param index Slot index
+ * @return Slot, or NULL if index is out of range
+ */
+const firmware_slot_t *firmware_slots_get(int index);
+
+/**
+ * @brief Get the slot backed by a partition
+ * @param partition App partition
+ * @return Slot index, -1 if the partition is not a slot
+ */
+int firmware_slots_index_of(const esp_partition_t *partition);
+
+/**
+ * @brief Find the slot holding an image
+ * @param digest Key of the image file, see firmware_digest_key_of_file()
+ * @return Slot index, -1 if the image is not resident
+ */
+int firmware_slots_find(const uint8_t *digest);
+
+/**
+ * @brief Pick the slot a new image should be flashed to
+ * Prefers the smallest empty slot that fits, otherwise evicts the least
+ * recently used occupied slot that fits.
+ * @param image_size Image size in bytes
+ * @return Slot index, -1 if no slot is large enough
+ */
+int firmware_slots_select(size_t image_size);
+
+/**
+ * @brief Get the most recently used occupied slot
+ * @return Slot index, -1 if every slot is empty
+ */
+int firmware_slots_most_recent(void);
+
+/**
+ * @brief Mark a slot empty, call before overwriting its partition
+ * @param index Slot index
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t firmware_slots_release(int index);
+
+/**
+ * @brief Record a freshly flashed image and mark it most recently used
+ * The version is read from the image's app description.
+ * @param index Slot index
+ * @param name File name the image was flashed from
+ * @param digest Key of the image file, see firmware_digest_key_of_file()
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t firmware_slots_record(int index, const char *name, const uint8_t *digest);
+
+/**
+ * @brief Mark a slot most recently used
+ * @param index Slot index
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t firmware_slots_touch(int index);
+
+#endif // FIRMWARE_SLOTS_H
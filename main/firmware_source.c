@@ -0,0 +1,246 @@
+#include "firmware_source.h"
+#include "sd_manager.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "zlib.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "FIRMWARE_SOURCE";
+
+// Compressed bytes pulled from the card per read, independent of the output chunk size
+#define INPUT_BUFFER_SIZE (32 * 1024)
+#define GZIP_TRAILER_SIZE 8
+
+struct firmware_source {
+    sd_raw_file_t *file;
+    firmware_compression_t compression;
+    size_t stored_size;
+    size_t image_size;
+    size_t produced;
+    z_stream stream;
+    bool stream_ready;
+    bool stream_end;
+    uint8_t *input;
+};
+
+static bool has_suffix(const char *name, const char *suffix) {
+    size_t len = strlen(name);
+    size_t suffix_len = strlen(suffix);
+    return len >= suffix_len && strcmp(name + len - suffix_len, suffix) == 0;
+}
+
+bool firmware_source_is_image_file(const char *filename) {
+    return has_suffix(filename, ".bin") || has_suffix(filename, ".bin.gz");
+}
+
+firmware_compression_t firmware_source_compression_of(const char *filename) {
+    return has_suffix(filename, ".gz") ? FIRMWARE_COMPRESSION_GZIP : FIRMWARE_COMPRESSION_NONE;
+}
+
+// zlib allocates its 32 KB window and state here, keep them out of internal RAM
+static voidpf zalloc_psram(voidpf opaque, uInt items, uInt size) {
+    void *p = heap_caps_calloc(items, size, MALLOC_CAP_SPIRAM);
+    return p ? p : calloc(items, size);
+}
+
+static void zfree_psram(voidpf opaque, voidpf address) {
+    heap_caps_free(address);
+}
+
+static esp_err_t read_gzip_image_size(sd_raw_file_t *file, size_t stored_size, size_t *image_size) {
+    // The gzip trailer ends with ISIZE, the uncompressed length modulo 2^32
+    uint8_t isize[4];
+    size_t got = 0;
+    if (stored_size < GZIP_TRAILER_SIZE || sd_manager_raw_seek(file, stored_size - 4) != ESP_OK ||
+        sd_manager_raw_read(file, isize, 4, &got) != ESP_OK || got != 4) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *image_size = (size_t)isize[0] | ((size_t)isize[1] << 8) | ((size_t)isize[2] << 16) | ((size_t)isize[3] << 24);
+    return ESP_OK;
+}
+
+esp_err_t firmware_source_get_image_size(const char *path, size_t stored_size, size_t *image_size) {
+    if (firmware_source_compression_of(path) == FIRMWARE_COMPRESSION_NONE) {
+        *image_size = stored_size;
+        return ESP_OK;
+    }
+
+    sd_raw_file_t *file;
+    esp_err_t ret = sd_manager_raw_open(path, &file);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = read_gzip_image_size(file, stored_size, image_size);
+    sd_manager_raw_close(file);
+    return ret;
+}
+
+static esp_err_t start_stream(firmware_source_t *src) {
+    memset(&src->stream, 0, sizeof(src->stream));
+    src->stream.zalloc = zalloc_psram;
+    src->stream.zfree = zfree_psram;
+    // 16 + MAX_WBITS selects the gzip wrapper with the standard 32 KB window
+    if (inflateInit2(&src->stream, 16 + MAX_WBITS) != Z_OK) {
+        return ESP_ERR_NO_MEM;
+    }
+    src->stream_ready = true;
+    src->stream_end = false;
+    return ESP_OK;
+}
+
+esp_err_t firmware_source_open(const char *path, firmware_source_t **out) {
+    firmware_source_t *src = calloc(1, sizeof(firmware_source_t));
+    if (!src) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    src->compression = firmware_source_compression_of(path);
+    esp_err_t ret = sd_manager_raw_open(path, &src->file);
+    if (ret != ESP_OK) {
+        free(src);
+        return ret;
+    }
+
+    src->stored_size = sd_manager_raw_size(src->file);
+    if (src->compression == FIRMWARE_COMPRESSION_GZIP) {
+        ret = read_gzip_image_size(src->file, src->stored_size, &src->image_size);
+        if (ret == ESP_OK) {
+            // Compressed input is pulled in whole clusters, straight from the card
+            src->input = sd_manager_raw_alloc(INPUT_BUFFER_SIZE);
+            ret = src->input ? start_stream(src) : ESP_ERR_NO_MEM;
+        }
+    } else {
+        src->image_size = src->stored_size;
+    }
+
+    if (ret == ESP_OK) {
+        ret = sd_manager_raw_seek(src->file, 0);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open %s: %s", path, esp_err_to_name(ret));
+        firmware_source_close(src);
+        return ret;
+    }
+
+    *out = src;
+    return ESP_OK;
+}
+
+static esp_err_t inflate_into(firmware_source_t *src, uint8_t *buf, size_t len, size_t *out_len) {
+    z_stream *zs = &src->stream;
+    zs->next_out = buf;
+    zs->avail_out = len;
+
+    while (zs->avail_out > 0 && !src->stream_end) {
+        if (zs->avail_in == 0) {
+            size_t n = 0;
+            esp_err_t ret = sd_manager_raw_read(src->file, src->input, INPUT_BUFFER_SIZE, &n);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+            if (n == 0) {
+                ESP_LOGE(TAG, "Compressed stream ended early");
+                return ESP_ERR_INVALID_SIZE;
+            }
+            zs->next_in = src->input;
+            zs->avail_in = n;
+        }
+
+        int zret = inflate(zs, Z_NO_FLUSH);
+        if (zret == Z_STREAM_END) {
+            src->stream_end = true;
+        } else if (zret != Z_OK && zret != Z_BUF_ERROR) {
+            ESP_LOGE(TAG, "Decompression failed: %d (%s)", zret, zs->msg ? zs->msg : "no message");
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+    }
+
+    *out_len = len - zs->avail_out;
+    return ESP_OK;
+}
+
+// Runs the stream into its trailer, where zlib checks the CRC32 of everything inflated
+static esp_err_t finish_stream(firmware_source_t *src) {
+    uint8_t extra;
+    size_t got = 0;
+    esp_err_t ret = inflate_into(src, &extra, 1, &got);
+    if (ret == ESP_OK && (got != 0 || !src->stream_end)) {
+        ESP_LOGE(TAG, "Compressed stream is longer than its recorded size");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ret;
+}
+
+esp_err_t firmware_source_read(firmware_source_t *src, void *buf, size_t len, size_t *out_len) {
+    size_t remaining = src->image_size - src->produced;
+    if (len > remaining) {
+        len = remaining;
+    }
+
+    esp_err_t ret = ESP_OK;
+    size_t got = 0;
+    if (src->compression == FIRMWARE_COMPRESSION_GZIP) {
+        ret = inflate_into(src, buf, len, &got);
+    } else {
+        // Aligned buffers at aligned offsets, such as the flash ring, are filled by DMA
+        ret = sd_manager_raw_read(src->file, buf, len, &got);
+    }
+
+    src->produced += got;
+    *out_len = got;
+    if (ret == ESP_OK && src->compression == FIRMWARE_COMPRESSION_GZIP &&
+        src->produced == src->image_size && !src->stream_end) {
+        ret = finish_stream(src);
+    }
+    return ret;
+}
+
+esp_err_t firmware_source_skip(firmware_source_t *src, size_t len) {
+    if (src->compression != FIRMWARE_COMPRESSION_NONE) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (len > src->image_size - src->produced) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    esp_err_t ret = sd_manager_raw_seek(src->file, src->produced + len);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    src->produced += len;
+    return ESP_OK;
+}
+
+esp_err_t firmware_source_rewind(firmware_source_t *src) {
+    src->produced = 0;
+    esp_err_t ret = sd_manager_raw_seek(src->file, 0);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (src->compression == FIRMWARE_COMPRESSION_GZIP) {
+        inflateEnd(&src->stream);
+        src->stream_ready = false;
+        return start_stream(src);
+    }
+    return ESP_OK;
+}
+
+size_t firmware_source_image_size(const firmware_source_t *src) {
+    return src->image_size;
+}
+
+firmware_compression_t firmware_source_compression(const firmware_source_t *src) {
+    return src->compression;
+}
+
+void firmware_source_close(firmware_source_t *src) {
+    if (!src) {
+        return;
+    }
+    if (src->stream_ready) {
+        inflateEnd(&src->stream);
+    }
+    sd_manager_raw_close(src->file);
+    heap_caps_free(src->input);
+    free(src);
+}
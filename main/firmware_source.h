@@ -0,0 +1,94 @@
+#ifndef FIRMWARE_SOURCE_H
+#define FIRMWARE_SOURCE_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef enum {
+    FIRMWARE_COMPRESSION_NONE = 0,  // Plain .bin
+    FIRMWARE_COMPRESSION_GZIP,      // .bin.gz, inflated with a 32 KB window
+} firmware_compression_t;
+
+typedef struct firmware_source firmware_source_t;
+
+/**
+ * @brief Check if a file name looks like a firmware image this loader can flash
+ * @param filename File name or path
+ * @return true for .bin and .bin.gz files
+ */
+bool firmware_source_is_image_file(const char *filename);
+
+/**
+ * @brief Get the compression format implied by a file name
+ * @param filename File name or path
+ * @return Compression format, FIRMWARE_COMPRESSION_NONE for plain images
+ */
+firmware_compression_t firmware_source_compression_of(const char *filename);
+
+/**
+ * @brief Get the uncompressed image size of a firmware file without decompressing it
+ * @param path File path (relative to SD root)
+ * @param stored_size Size of the file on the card
+ * @param image_size Output, size of the image once decompressed
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t firmware_source_get_image_size(const char *path, size_t stored_size, size_t *image_size);
+
+/**
+ * @brief Open a firmware file for streaming, decompressing on the fly if needed
+ * @param path File path (relative to SD root)
+ * @param out Output source handle
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t firmware_source_open(const char *path, firmware_source_t **out);
+
+/**
+ * @brief Read the next bytes of the uncompressed image
+ * @param src Source handle
+ * @param buf Output buffer
+ * @param len Number of bytes wanted
+ * @param out_len Number of bytes produced, less than len only at the end of the image
+ * @return ESP_OK on success, error code on I/O or format errors. The read that
+ *         completes a compressed image also fails if the gzip CRC32 does not match.
+ */
+esp_err_t firmware_source_read(firmware_source_t *src, void *buf, size_t len, size_t *out_len);
+
+/**
+ * @brief Skip bytes of the image without reading them
+ * @param src Source handle
+ * @param len Number of bytes to skip
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED for compressed sources,
+ *         which could only skip by inflating, ESP_ERR_INVALID_SIZE past the end
+ */
+esp_err_t firmware_source_skip(firmware_source_t *src, size_t len);
+
+/**
+ * @brief Restart reading from the beginning of the image
+ * @param src Source handle
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t firmware_source_rewind(firmware_source_t *src);
+
+/**
+ * @brief Get the uncompressed image size
+ * @param src Source handle
+ * @return Image size in bytes
+ */
+size_t firmware_source_image_size(const firmware_source_t *src);
+
+/**
+ * @brief Get the compression format of an open source
+ * @param src Source handle
+ * @return Compression format
+ */
+firmware_compression_t firmware_source_compression(const firmware_source_t *src);
+
+/**
+ * @brief Close a source and release its buffers
+ * @param src Source handle, may be NULL
+ */
+void firmware_source_close(firmware_source_t *src);
+
+#endif // FIRMWARE_SOURCE_H
@@ -0,0 +1,431 @@
+#include "flash_engine.h"
+#include "flash_erase.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_image_format.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "mbedtls/sha256.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <inttypes.h>
+
+static const char *TAG = "FLASH_ENGINE";
+
+#define READER_TASK_STACK    4096
+#define READER_TASK_PRIORITY 5
+#define CHUNK_NONE           (-1)
+
+typedef struct {
+    const flash_engine_job_t *job;
+    uint8_t *ring;                  // chunk_count slots of chunk_size bytes
+    size_t chunk_size;
+    size_t chunk_count;
+    size_t chunk_len[FLASH_ENGINE_DEFAULT_CHUNK_COUNT * 4];
+    QueueHandle_t free_queue;       // Slot indices ready to be filled
+    QueueHandle_t full_queue;       // Slot indices ready to be written, in file order
+    SemaphoreHandle_t reader_done;
+    volatile bool failed;           // Set by the writer so the reader stops early
+    esp_err_t reader_result;
+    flash_engine_stats_t *stats;
+} flash_pipeline_t;
+
+static volatile bool abort_requested = false;
+
+void flash_engine_abort(void) {
+    abort_requested = true;
+}
+
+static uint8_t *alloc_ring(size_t size) {
+    // Prefer DMA-capable PSRAM so the ring never competes with internal RAM
+    uint8_t *ring = heap_caps_aligned_alloc(FLASH_ENGINE_BUFFER_ALIGN, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_DMA);
+    if (!ring) {
+        ring = heap_caps_aligned_alloc(FLASH_ENGINE_BUFFER_ALIGN, size, MALLOC_CAP_SPIRAM);
+    }
+    if (!ring) {
+        ring = heap_caps_aligned_alloc(FLASH_ENGINE_BUFFER_ALIGN, size, MALLOC_CAP_DEFAULT);
+    }
+    return ring;
+}
+
+// Feed one chunk into the running image hash. Everything before hash_offset is
+// hashed, the 32 bytes at it are the expected digest and anything behind them,
+// such as a signature block or padding, is covered by neither.
+static void hash_chunk(flash_pipeline_t *p, mbedtls_sha256_context *sha, size_t offset,
+                       const uint8_t *data, size_t len, uint8_t *expected) {
+    size_t hash_start = p->job->hash_offset;
+    size_t hash_end = hash_start + FLASH_ENGINE_DIGEST_LEN;
+
+    if (offset < hash_start) {
+        size_t n = (hash_start - offset < len) ? hash_start - offset : len;
+        mbedtls_sha256_update(sha, data, n);
+    }
+    size_t from = (offset < hash_start) ? hash_start : offset;
+    size_t to = (offset + len < hash_end) ? offset + len : hash_end;
+    for (size_t pos = from; pos < to; pos++) {
+        expected[pos - hash_start] = data[pos - offset];
+    }
+}
+
+static void reader_task(void *arg) {
+    flash_pipeline_t *p = (flash_pipeline_t *)arg;
+    const flash_engine_job_t *job = p->job;
+    size_t offset = 0;
+    int idx;
+    uint8_t expected[FLASH_ENGINE_DIGEST_LEN];
+    mbedtls_sha256_context sha;
+
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    p->reader_result = ESP_OK;
+
+    while (offset < job->image_size) {
+        int64_t t0 = esp_timer_get_time();
+        xQueueReceive(p->free_queue, &idx, portMAX_DELAY);
+        int64_t t1 = esp_timer_get_time();
+        p->stats->reader_stall_us += t1 - t0;
+
+        if (abort_requested || p->failed || idx == CHUNK_NONE) {
+            p->reader_result = ESP_ERR_INVALID_STATE;
+            break;
+        }
+
+        size_t want = job->image_size - offset;
+        if (want > p->chunk_size) {
+            want = p->chunk_size;
+        }
+
+        uint8_t *data = p->ring + (size_t)idx * p->chunk_size;
+        size_t got = 0;
+        esp_err_t ret = firmware_source_read(job->source, data, want, &got);
+        int64_t t2 = esp_timer_get_time();
+        p->stats->read_us += t2 - t1;
+
+        if (ret != ESP_OK || got != want) {
+            ESP_LOGE(TAG, "Short read at offset %zu: %zu / %zu bytes", offset, got, want);
+            p->reader_result = (ret != ESP_OK) ? ret : ESP_ERR_INVALID_SIZE;
+            break;
+        }
+
+        p->chunk_len[idx] = got;
+        p->stats->bytes_read = offset + got;
+        xQueueSend(p->full_queue, &idx, portMAX_DELAY);
+
+        // Hash after handing the chunk over: the writer only reads the slot and the
+        // reader is the only one that refills it, so this overlaps with programming
+        if (job->hash_offset > 0) {
+            int64_t t3 = esp_timer_get_time();
+            hash_chunk(p, &sha, offset, data, got, expected);
+            p->stats->hash_us += esp_timer_get_time() - t3;
+        }
+        offset += got;
+    }
+
+    if (p->reader_result == ESP_OK && job->hash_offset > 0) {
+        uint8_t digest[FLASH_ENGINE_DIGEST_LEN];
+        mbedtls_sha256_finish(&sha, digest);
+        if (memcmp(digest, expected, FLASH_ENGINE_DIGEST_LEN) != 0) {
+            ESP_LOGE(TAG, "Image SHA-256 does not match its appended hash, the file is corrupt");
+            p->reader_result = ESP_ERR_INVALID_CRC;
+        } else {
+            p->stats->digest_verified = true;
+        }
+    }
+    mbedtls_sha256_free(&sha);
+
+    if (p->reader_result != ESP_OK) {
+        // Wake the writer so it notices the failure instead of waiting forever
+        idx = CHUNK_NONE;
+        xQueueSend(p->full_queue, &idx, portMAX_DELAY);
+    }
+
+    xSemaphoreGive(p->reader_done);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t verify_chunk(flash_pipeline_t *p, size_t offset, const uint8_t *data, size_t len) {
+    const void *mapped = NULL;
+    esp_partition_mmap_handle_t map_handle;
+
+    // Read back through the flash cache and compare in place, no temporary copy
+    int64_t t0 = esp_timer_get_time();
+    esp_err_t ret = esp_partition_mmap(p->job->partition, offset, len, ESP_PARTITION_MMAP_DATA, &mapped, &map_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map 0x%zx for verification: %s", offset, esp_err_to_name(ret));
+        return ret;
+    }
+
+    for (size_t pos = 0; pos < len; pos += FLASH_ENGINE_DIFF_BLOCK_SIZE) {
+        size_t n = (len - pos < FLASH_ENGINE_DIFF_BLOCK_SIZE) ? len - pos : FLASH_ENGINE_DIFF_BLOCK_SIZE;
+        if (memcmp((const uint8_t *)mapped + pos, data + pos, n) != 0) {
+            ESP_LOGE(TAG, "Verify failed: block at offset 0x%zx does not match what was written", offset + pos);
+            ret = ESP_ERR_INVALID_CRC;
+            break;
+        }
+    }
+
+    esp_partition_munmap(map_handle);
+    p->stats->verify_us += esp_timer_get_time() - t0;
+    return ret;
+}
+
+static esp_err_t program_range(flash_pipeline_t *p, flash_erase_sched_t *erase, size_t offset,
+                               const uint8_t *data, size_t len) {
+    esp_err_t ret = flash_erase_sched_ensure(erase, offset + len);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    ret = esp_partition_write(p->job->partition, offset, data, len);
+    p->stats->write_us += esp_timer_get_time() - t0;
+    return ret;
+}
+
+static esp_err_t write_chunk_differential(flash_pipeline_t *p, size_t offset, const uint8_t *data, size_t len) {
+    const esp_partition_t *partition = p->job->partition;
+    const void *mapped = NULL;
+    esp_partition_mmap_handle_t map_handle;
+    uint32_t dirty = 0;
+    size_t block_count = (len + FLASH_ENGINE_DIFF_BLOCK_SIZE - 1) / FLASH_ENGINE_DIFF_BLOCK_SIZE;
+
+    // Compare against the current contents through the cache, no readback copy needed
+    int64_t t0 = esp_timer_get_time();
+    if (esp_partition_mmap(partition, offset, len, ESP_PARTITION_MMAP_DATA, &mapped, &map_handle) == ESP_OK) {
+        for (size_t b = 0; b < block_count; b++) {
+            size_t pos = b * FLASH_ENGINE_DIFF_BLOCK_SIZE;
+            size_t n = (len - pos < FLASH_ENGINE_DIFF_BLOCK_SIZE) ? len - pos : FLASH_ENGINE_DIFF_BLOCK_SIZE;
+            if (memcmp((const uint8_t *)mapped + pos, data + pos, n) != 0) {
+                dirty |= 1u << b;
+            }
+        }
+        esp_partition_munmap(map_handle);
+    } else {
+        dirty = (block_count >= 32) ? UINT32_MAX : (1u << block_count) - 1;
+    }
+    p->stats->compare_us += esp_timer_get_time() - t0;
+
+    // Erase and program each run of consecutive changed blocks in one go
+    esp_err_t ret = ESP_OK;
+    size_t b = 0;
+    while (b < block_count && ret == ESP_OK) {
+        if (!(dirty & (1u << b))) {
+            p->stats->bytes_skipped += (b + 1 == block_count) ? len - b * FLASH_ENGINE_DIFF_BLOCK_SIZE : FLASH_ENGINE_DIFF_BLOCK_SIZE;
+            b++;
+            continue;
+        }
+
+        size_t first = b;
+        while (b < block_count && (dirty & (1u << b))) {
+            b++;
+        }
+
+        size_t start = first * FLASH_ENGINE_DIFF_BLOCK_SIZE;
+        size_t end = (b == block_count) ? len : b * FLASH_ENGINE_DIFF_BLOCK_SIZE;
+        flash_erase_sched_t erase;
+        flash_erase_sched_init(&erase, partition, offset + start, offset + end, 0);
+        ret = program_range(p, &erase, offset + start, data + start, end - start);
+        p->stats->erase_us += erase.erase_us;
+    }
+
+    return ret;
+}
+
+static esp_err_t run_writer(flash_pipeline_t *p, flash_erase_sched_t *erase) {
+    const flash_engine_job_t *job = p->job;
+    size_t written = 0;
+    int idx;
+
+    while (written < job->image_size) {
+        int64_t t0 = esp_timer_get_time();
+        xQueueReceive(p->full_queue, &idx, portMAX_DELAY);
+        int64_t t1 = esp_timer_get_time();
+        p->stats->writer_stall_us += t1 - t0;
+
+        if (idx == CHUNK_NONE) {
+            return p->reader_result;
+        }
+
+        const uint8_t *data = p->ring + (size_t)idx * p->chunk_size;
+        esp_err_t ret = ESP_OK;
+        if (abort_requested) {
+            ret = ESP_ERR_INVALID_STATE;
+        } else if (written == 0 && data[0] != ESP_IMAGE_HEADER_MAGIC) {
+            ESP_LOGE(TAG, "Image does not start with an app header (0x%02x)", data[0]);
+            ret = ESP_ERR_INVALID_ARG;
+        } else if (job->differential || written < job->resume_offset) {
+            ret = write_chunk_differential(p, written, data, p->chunk_len[idx]);
+        } else {
+            // Keep one erase block ahead of the cursor so the next chunk lands on clean flash
+            ret = program_range(p, erase, written, data, p->chunk_len[idx]);
+        }
+
+        if (ret == ESP_OK) {
+            ret = verify_chunk(p, written, data, p->chunk_len[idx]);
+        }
+
+        if (ret != ESP_OK) {
+            if (ret != ESP_ERR_INVALID_STATE) {
+                ESP_LOGE(TAG, "Write failed at offset %zu: %s", written, esp_err_to_name(ret));
+            }
+            // Hand the slot back poisoned so a reader blocked on the ring exits
+            p->failed = true;
+            idx = CHUNK_NONE;
+            xQueueSend(p->free_queue, &idx, portMAX_DELAY);
+            return ret;
+        }
+
+        written += p->chunk_len[idx];
+        p->stats->bytes_written = written;
+        xQueueSend(p->free_queue, &idx, portMAX_DELAY);
+
+        if (job->journal) {
+            flash_journal_advance(job->journal, written);
+        }
+
+        if (job->progress_callback) {
+            job->progress_callback(written, job->image_size, FIRMWARE_STEP_WRITING);
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t flash_engine_run(const flash_engine_job_t *job, flash_engine_stats_t *stats) {
+    flash_engine_stats_t local_stats;
+    if (!stats) {
+        stats = &local_stats;
+    }
+    memset(stats, 0, sizeof(*stats));
+
+    if (!job || !job->source || !job->partition || job->image_size == 0 ||
+        (job->hash_offset > 0 && job->hash_offset + FLASH_ENGINE_DIGEST_LEN > job->image_size)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    flash_pipeline_t p = {
+        .job = job,
+        .chunk_size = job->chunk_size ? job->chunk_size : FLASH_ENGINE_DEFAULT_CHUNK_SIZE,
+        .chunk_count = job->chunk_count ? job->chunk_count : FLASH_ENGINE_DEFAULT_CHUNK_COUNT,
+        .stats = stats,
+    };
+
+    size_t max_chunks = sizeof(p.chunk_len) / sizeof(p.chunk_len[0]);
+    if (p.chunk_count < 2 || p.chunk_count > max_chunks || (p.chunk_size % FLASH_ENGINE_BUFFER_ALIGN) != 0 ||
+        p.chunk_size > FLASH_ENGINE_DIFF_BLOCK_SIZE * 32 || (p.chunk_size % FLASH_ENGINE_DIFF_BLOCK_SIZE) != 0) {
+        ESP_LOGE(TAG, "Unsupported ring geometry: %zu x %zu bytes", p.chunk_count, p.chunk_size);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (job->image_size > job->partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    abort_requested = false;
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t ret = ESP_ERR_NO_MEM;
+
+    p.ring = alloc_ring(p.chunk_size * p.chunk_count);
+    p.free_queue = xQueueCreate(p.chunk_count + 1, sizeof(int));
+    p.full_queue = xQueueCreate(p.chunk_count + 1, sizeof(int));
+    p.reader_done = xSemaphoreCreateBinary();
+    if (!p.ring || !p.free_queue || !p.full_queue || !p.reader_done) {
+        ESP_LOGE(TAG, "Failed to allocate %zu byte ring", p.chunk_size * p.chunk_count);
+        goto cleanup;
+    }
+
+    for (int i = 0; i < (int)p.chunk_count; i++) {
+        xQueueSend(p.free_queue, &i, 0);
+    }
+
+    // Only the sectors the image covers get erased, interleaved with programming.
+    // In differential mode each changed run is erased on its own instead.
+    // A resume compares its way up to the first chunk boundary past the journalled
+    // watermark, fresh erasing starts there since flash above it may be half written
+    size_t erase_start = 0;
+    if (job->resume_offset > 0) {
+        erase_start = (job->resume_offset + p.chunk_size - 1) / p.chunk_size * p.chunk_size;
+        ESP_LOGI(TAG, "Resuming at 0x%zx, verifying below it", job->resume_offset);
+    }
+    flash_erase_sched_t erase;
+    flash_erase_sched_init(&erase, job->partition, erase_start, job->image_size, FLASH_ERASE_BLOCK_SIZE);
+    if (job->progress_callback) job->progress_callback(0, job->image_size, FIRMWARE_STEP_STARTING);
+
+    // Run the reader on the core the caller is not using so SD and flash I/O overlap
+    if (xTaskCreatePinnedToCore(reader_task, "flash_reader", READER_TASK_STACK, &p,
+                                READER_TASK_PRIORITY, NULL, (xPortGetCoreID() == 0) ? 1 : 0) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create reader task");
+        ret = ESP_ERR_NO_MEM;
+        goto cleanup;
+    }
+
+    ret = run_writer(&p, &erase);
+    stats->erase_us += erase.erase_us;
+
+    // The reader owns a ring slot until it exits, never free the ring before that
+    xSemaphoreTake(p.reader_done, portMAX_DELAY);
+
+    if (ret == ESP_OK) {
+        // The last chunk can be written before the reader has checked the image hash
+        ret = p.reader_result;
+    }
+    if (ret != ESP_OK) {
+        goto cleanup;
+    }
+
+    if (job->progress_callback) job->progress_callback(job->image_size, job->image_size, FIRMWARE_STEP_FINALIZING);
+    esp_partition_pos_t part_pos = {
+        .offset = job->partition->address,
+        .size = job->partition->size,
+    };
+    esp_image_metadata_t metadata;
+    if (stats->digest_verified) {
+        // Streamed hash matched the image's own digest and every chunk read back
+        // identical, so rehashing flash would prove nothing new. The header and
+        // segment layout are still walked, without hashing; the chip was checked
+        // on the source before anything was erased.
+        if (esp_image_get_metadata(&part_pos, &metadata) != ESP_OK) {
+            ESP_LOGE(TAG, "Written image has an invalid segment layout");
+            ret = ESP_ERR_OTA_VALIDATE_FAILED;
+        }
+    } else if (esp_image_verify(ESP_IMAGE_VERIFY, &part_pos, &metadata) != ESP_OK) {
+        // No appended hash to check against, fall back to what esp_ota_end() performs
+        ESP_LOGE(TAG, "Written image failed validation");
+        ret = ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+cleanup:
+    stats->total_us = esp_timer_get_time() - start_us;
+    if (p.reader_done) vSemaphoreDelete(p.reader_done);
+    if (p.full_queue) vQueueDelete(p.full_queue);
+    if (p.free_queue) vQueueDelete(p.free_queue);
+    heap_caps_free(p.ring);
+    return ret;
+}
+
+static float mb_per_s(size_t bytes, int64_t us) {
+    return (us > 0) ? ((float)bytes / (1024.0f * 1024.0f)) / ((float)us / 1000000.0f) : 0.0f;
+}
+
+void flash_engine_log_stats(const flash_engine_stats_t *stats) {
+    ESP_LOGI(TAG, "SD read:     %zu bytes in %" PRId64 " ms (%.2f MB/s)",
+             stats->bytes_read, stats->read_us / 1000, mb_per_s(stats->bytes_read, stats->read_us));
+    if (stats->bytes_skipped > 0 || stats->compare_us > 0) {
+        ESP_LOGI(TAG, "Compare:     %" PRId64 " ms, %zu unchanged bytes skipped",
+                 stats->compare_us / 1000, stats->bytes_skipped);
+    }
+    ESP_LOGI(TAG, "Flash erase: %" PRId64 " ms", stats->erase_us / 1000);
+    size_t programmed = stats->bytes_written - stats->bytes_skipped;
+    ESP_LOGI(TAG, "Flash write: %zu bytes in %" PRId64 " ms (%.2f MB/s)",
+             programmed, stats->write_us / 1000, mb_per_s(programmed, stats->write_us));
+    ESP_LOGI(TAG, "Hash:        %" PRId64 " ms on the reader, image digest %s",
+             stats->hash_us / 1000, stats->digest_verified ? "verified" : "not appended");
+    ESP_LOGI(TAG, "Verify:      %" PRId64 " ms of mapped readback", stats->verify_us / 1000);
+    ESP_LOGI(TAG, "Stalls:      reader %" PRId64 " ms, writer %" PRId64 " ms",
+             stats->reader_stall_us / 1000, stats->writer_stall_us / 1000);
+    ESP_LOGI(TAG, "Total:       %" PRId64 " ms (%.2f MB/s end to end)",
+             stats->total_us / 1000, mb_per_s(stats->bytes_written, stats->total_us));
+}
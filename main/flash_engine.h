@@ -0,0 +1,82 @@
+#ifndef FLASH_ENGINE_H
+#define FLASH_ENGINE_H
+
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "firmware_loader.h"
+#include "firmware_source.h"
+#include "flash_journal.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FLASH_ENGINE_DEFAULT_CHUNK_SIZE   (64 * 1024)
+#define FLASH_ENGINE_DEFAULT_CHUNK_COUNT  4
+#define FLASH_ENGINE_BUFFER_ALIGN         128
+#define FLASH_ENGINE_DIFF_BLOCK_SIZE      (4 * 1024)
+#define FLASH_ENGINE_DIGEST_LEN           32
+
+typedef struct {
+    firmware_source_t *source;                      // Image stream, read sequentially from offset 0
+    size_t image_size;                              // Number of bytes to copy
+    size_t hash_offset;                             // Appended SHA-256 from firmware_image_parse(), 0 to skip the check
+    const esp_partition_t *partition;               // Target app partition
+    size_t chunk_size;                              // Ring slot size, 0 for default
+    size_t chunk_count;                             // Ring slot count, 0 for default
+    bool differential;                              // Only rewrite blocks that differ from the partition
+    size_t resume_offset;                           // Bytes an interrupted flash already committed
+    flash_journal_t *journal;                       // Optional, advanced as chunks are verified
+    firmware_progress_callback_t progress_callback; // Optional, called once per chunk
+} flash_engine_job_t;
+
+typedef struct {
+    size_t bytes_read;
+    size_t bytes_written;
+    size_t bytes_skipped;       // Differential mode: bytes already matching the partition
+    int64_t read_us;            // Time the reader spent reading and decompressing
+    int64_t compare_us;         // Differential mode: time spent comparing against the partition
+    int64_t erase_us;           // Time the writer spent erasing ahead of the cursor
+    int64_t write_us;           // Time the writer spent programming flash
+    int64_t hash_us;            // Time the reader spent hashing, overlapped with programming
+    int64_t verify_us;          // Time the writer spent comparing mapped flash with the ring
+    int64_t reader_stall_us;    // Reader blocked on a full ring (back-pressure)
+    int64_t writer_stall_us;    // Writer blocked on an empty ring
+    int64_t total_us;           // Wall-clock time of the whole copy
+    bool digest_verified;       // Streamed SHA-256 matched the image's appended hash
+} flash_engine_stats_t;
+
+/**
+ * @brief Copy an image into an app partition through the reader/writer pipeline
+ *
+ * A reader task pinned to the other core fills a PSRAM ring of chunks from
+ * the source, decompressing on the fly, while the calling task drains them into the partition,
+ * erasing only the sectors the image covers just ahead of the write cursor.
+ * In differential mode every 4 KB block is compared with the partition first
+ * and only the blocks that differ are erased and programmed. When resuming,
+ * everything below resume_offset is treated that way, so a block torn by the
+ * power loss is rewritten while intact ones cost a compare.
+ *
+ * The reader hashes everything before hash_offset as it streams and checks it
+ * against the 32 bytes found there; the writer reads every chunk back through a
+ * memory mapping and fails with the offset of the first bad 4 KB block.
+ *
+ * Blocks until the copy completes, fails or is aborted.
+ *
+ * @param job Copy description
+ * @param stats Optional per-stage timing output, may be NULL
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t flash_engine_run(const flash_engine_job_t *job, flash_engine_stats_t *stats);
+
+/**
+ * @brief Request the running copy to stop
+ * Both stages wind down and flash_engine_run() returns ESP_ERR_INVALID_STATE
+ */
+void flash_engine_abort(void);
+
+/**
+ * @brief Log per-stage throughput of a finished copy
+ * @param stats Stats filled by flash_engine_run()
+ */
+void flash_engine_log_stats(const flash_engine_stats_t *stats);
+
+#endif // FLASH_ENGINE_H
@@ -0,0 +1,46 @@
+#include "flash_erase.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "FLASH_ERASE";
+
+void flash_erase_sched_init(flash_erase_sched_t *sched, const esp_partition_t *partition,
+                            size_t start, size_t image_size, size_t lookahead) {
+    size_t end = (image_size + FLASH_ERASE_SECTOR_SIZE - 1) & ~(size_t)(FLASH_ERASE_SECTOR_SIZE - 1);
+    if (end > partition->size) {
+        end = partition->size;
+    }
+
+    sched->partition = partition;
+    sched->erased = start;
+    sched->end = end;
+    sched->lookahead = lookahead;
+    sched->erase_us = 0;
+}
+
+esp_err_t flash_erase_sched_ensure(flash_erase_sched_t *sched, size_t write_end) {
+    size_t target = write_end + sched->lookahead;
+    if (target > sched->end) {
+        target = sched->end;
+    }
+
+    while (sched->erased < target) {
+        // Block erase is several times faster per byte, use it whenever a whole block fits
+        size_t len = FLASH_ERASE_SECTOR_SIZE;
+        if ((sched->erased % FLASH_ERASE_BLOCK_SIZE) == 0 && sched->erased + FLASH_ERASE_BLOCK_SIZE <= sched->end) {
+            len = FLASH_ERASE_BLOCK_SIZE;
+        }
+
+        int64_t t0 = esp_timer_get_time();
+        esp_err_t ret = esp_partition_erase_range(sched->partition, sched->erased, len);
+        sched->erase_us += esp_timer_get_time() - t0;
+
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Erase at 0x%zx (%zu bytes) failed: %s", sched->erased, len, esp_err_to_name(ret));
+            return ret;
+        }
+        sched->erased += len;
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,40 @@
+#ifndef FLASH_ERASE_H
+#define FLASH_ERASE_H
+
+#include "esp_err.h"
+#include "esp_partition.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#define FLASH_ERASE_SECTOR_SIZE  (4 * 1024)
+#define FLASH_ERASE_BLOCK_SIZE   (64 * 1024)
+
+typedef struct {
+    const esp_partition_t *partition;
+    size_t erased;          // Erase watermark, everything below is erased
+    size_t end;             // Sector-aligned end of the region that needs erasing
+    size_t lookahead;       // How far ahead of the write cursor to keep erased
+    int64_t erase_us;       // Time spent erasing
+} flash_erase_sched_t;
+
+/**
+ * @brief Prepare to erase only the part of a partition an image will occupy
+ * @param sched Scheduler state
+ * @param partition Target partition
+ * @param start Offset the write cursor starts at, must be sector aligned
+ * @param image_size Image size in bytes, rounded up to whole sectors
+ * @param lookahead Bytes to keep erased ahead of the write cursor
+ */
+void flash_erase_sched_init(flash_erase_sched_t *sched, const esp_partition_t *partition,
+                            size_t start, size_t image_size, size_t lookahead);
+
+/**
+ * @brief Make sure [start, write_end + lookahead) is erased before programming
+ * Uses 64 KB block erases where aligned and falls back to 4 KB sectors at the edges.
+ * @param sched Scheduler state
+ * @param write_end End offset of the data about to be programmed
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t flash_erase_sched_ensure(flash_erase_sched_t *sched, size_t write_end);
+
+#endif // FLASH_ERASE_H
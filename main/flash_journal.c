@@ -0,0 +1,154 @@
+#include "flash_journal.h"
+#include "sd_manager.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const char *TAG = "FLASH_JOURNAL";
+static const char *NVS_NAMESPACE = "launcher";
+// The image identity is written once per flash, the watermark is a small
+// separate entry so each progress update rewrites only a few bytes.
+// Flash above it may be half programmed, a resume erases it again.
+static const char *NVS_KEY_IMAGE = "jr_image";
+static const char *NVS_KEY_COMMITTED = "jr_commit";
+
+// Committed watermark last written to NVS
+static uint32_t saved_committed = 0;
+
+static esp_err_t file_identity(const char *path, flash_journal_t *journal) {
+    char sd_path[MAX_FIRMWARE_PATH_LEN + sizeof(SD_MOUNT_POINT)];
+    snprintf(sd_path, sizeof(sd_path), "%s%s", SD_MOUNT_POINT, path);
+
+    struct stat st;
+    esp_err_t ret = sd_manager_fs_acquire();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    int stat_ret = stat(sd_path, &st);
+    sd_manager_fs_release();
+    if (stat_ret != 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    journal->file_size = st.st_size;
+    journal->file_mtime = st.st_mtime;
+    // Compressed files have no cheap digest, size and mtime have to do
+    if (firmware_digest_of_file(path, journal->digest) != ESP_OK) {
+        memset(journal->digest, 0, sizeof(journal->digest));
+    }
+    return ESP_OK;
+}
+
+esp_err_t flash_journal_load(flash_journal_t *journal) {
+    nvs_handle_t nvs_handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+    if (ret != ESP_OK) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    size_t size = sizeof(*journal);
+    ret = nvs_get_blob(nvs_handle, NVS_KEY_IMAGE, journal, &size);
+    if (ret == ESP_OK && size != sizeof(*journal)) {
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+    if (ret == ESP_OK) {
+        journal->committed = 0;
+        nvs_get_u32(nvs_handle, NVS_KEY_COMMITTED, &journal->committed);
+        journal->path[sizeof(journal->path) - 1] = '\0';
+    }
+    nvs_close(nvs_handle);
+
+    if (ret != ESP_OK) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    saved_committed = journal->committed;
+    return ESP_OK;
+}
+
+bool flash_journal_matches(const flash_journal_t *journal, const char *path, size_t image_size) {
+    if (strcmp(journal->path, path) != 0 || journal->image_size != image_size ||
+        journal->committed > journal->image_size) {
+        return false;
+    }
+
+    flash_journal_t current;
+    if (file_identity(path, &current) != ESP_OK) {
+        return false;
+    }
+    return current.file_size == journal->file_size && current.file_mtime == journal->file_mtime &&
+           memcmp(current.digest, journal->digest, sizeof(current.digest)) == 0;
+}
+
+esp_err_t flash_journal_begin(flash_journal_t *journal, const char *path, int slot, size_t image_size) {
+    memset(journal, 0, sizeof(*journal));
+    strncpy(journal->path, path, sizeof(journal->path) - 1);
+    journal->image_size = image_size;
+    journal->slot = slot;
+
+    esp_err_t ret = file_identity(path, journal);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    nvs_handle_t nvs_handle;
+    ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ret = nvs_set_blob(nvs_handle, NVS_KEY_IMAGE, journal, sizeof(*journal));
+    if (ret == ESP_OK) {
+        ret = nvs_set_u32(nvs_handle, NVS_KEY_COMMITTED, 0);
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start journal: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    saved_committed = 0;
+    return ESP_OK;
+}
+
+void flash_journal_advance(flash_journal_t *journal, size_t committed) {
+    journal->committed = committed;
+    if (committed < saved_committed + FLASH_JOURNAL_INTERVAL) {
+        return;
+    }
+
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK) {
+        return;
+    }
+    esp_err_t ret = nvs_set_u32(nvs_handle, NVS_KEY_COMMITTED, committed);
+    if (ret == ESP_OK) {
+        ret = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (ret == ESP_OK) {
+        saved_committed = committed;
+    } else {
+        ESP_LOGW(TAG, "Failed to save progress: %s", esp_err_to_name(ret));
+    }
+}
+
+esp_err_t flash_journal_clear(void) {
+    nvs_handle_t nvs_handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    nvs_erase_key(nvs_handle, NVS_KEY_IMAGE);
+    nvs_erase_key(nvs_handle, NVS_KEY_COMMITTED);
+    ret = nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+    saved_committed = 0;
+    return ret;
+}
@@ -0,0 +1,65 @@
+#ifndef FLASH_JOURNAL_H
+#define FLASH_JOURNAL_H
+
+#include "esp_err.h"
+#include "firmware_loader.h"
+#include "firmware_digest.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define FLASH_JOURNAL_INTERVAL (256 * 1024)    // Minimum progress between NVS writes
+
+// Progress of an unfinished flash, persisted in NVS so it survives power loss
+typedef struct {
+    char path[MAX_FIRMWARE_PATH_LEN];       // Image file (relative to SD root)
+    uint8_t digest[FIRMWARE_DIGEST_LEN];    // File digest, all zero when unavailable (compressed)
+    uint32_t file_size;                     // Stored size of the file
+    int64_t file_mtime;                     // Modification time of the file
+    uint32_t image_size;                    // Bytes being written to the slot
+    uint32_t slot;                          // Firmware slot being written
+    uint32_t committed;                     // Everything below was programmed and read back
+} flash_journal_t;
+
+/**
+ * @brief Load the journal of an interrupted flash
+ * @param journal Output
+ * @return ESP_OK if a flash was interrupted, ESP_ERR_NOT_FOUND otherwise
+ */
+esp_err_t flash_journal_load(flash_journal_t *journal);
+
+/**
+ * @brief Check if a journal belongs to a file, i.e. the file has not changed since
+ * @param journal Loaded journal
+ * @param path File path (relative to SD root)
+ * @param image_size Image size the file decodes to
+ * @return true if the journalled flash can be resumed with this file
+ */
+bool flash_journal_matches(const flash_journal_t *journal, const char *path, size_t image_size);
+
+/**
+ * @brief Start journalling a new flash, replacing any previous journal
+ * @param journal Output
+ * @param path File path (relative to SD root)
+ * @param slot Firmware slot being written
+ * @param image_size Image size in bytes
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t flash_journal_begin(flash_journal_t *journal, const char *path, int slot, size_t image_size);
+
+/**
+ * @brief Record verified progress
+ * Only written to NVS once progress moved FLASH_JOURNAL_INTERVAL past the
+ * last saved watermark, so a resume redoes at most that much.
+ * @param journal Journal started with flash_journal_begin() or loaded for resume
+ * @param committed Bytes programmed and read back
+ */
+void flash_journal_advance(flash_journal_t *journal, size_t committed);
+
+/**
+ * @brief Drop the journal once a flash completed or the user discarded it
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t flash_journal_clear(void);
+
+#endif // FLASH_JOURNAL_H
@@ -2,6 +2,7 @@
 #include "gui_screens.h"
 #include "gui_progress.h"
 #include "gui_state.h"
+#include "gui_vlist.h"
 #include "firmware_loader.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
@@ -18,17 +19,17 @@ void main_menu_event_handler(lv_event_t *e) {
         switch (menu_id) {
             case 0: // File Manager
                 strcpy(current_directory, "/");  // Changed from "/sdcard" to "/"
+                gui_screen_load(GUI_SCREEN_FILE_MANAGER);
                 update_file_list();
-                lv_screen_load(file_manager_screen);
                 break;
             case 1: // Firmware Loader
+                gui_screen_load(GUI_SCREEN_FIRMWARE_LOADER);
                 update_firmware_list();
-                lv_screen_load(firmware_loader_screen);
                 break;
             case 2: // Run Firmware
                 if (firmware_loader_is_firmware_ready()) {
                     // Show splash screen for user choice
-                    lv_screen_load(splash_screen);
+                    gui_screen_load(GUI_SCREEN_SPLASH);
                 } else {
                     ESP_LOGW(TAG, "No firmware available to run");
                 }
@@ -40,26 +41,27 @@ void main_menu_event_handler(lv_event_t *e) {
 void file_list_event_handler(lv_event_t *e) {
     lv_event_code_t code = lv_event_get_code(e);
     if (code == LV_EVENT_CLICKED) {
-        int index = (int)(uintptr_t)lv_event_get_user_data(e);
+        size_t index = gui_vlist_get_item(e);
         
-        if (index >= 0 && index < current_entry_count) {
-            if (current_entries[index].is_directory) {
+        if (index < sd_listing_count(current_listing)) {
+            const file_entry_t *entry = sd_listing_get(current_listing, index);
+            if (entry->is_directory) {
                 // Navigate to directory
                 char temp_path[512];
                 size_t dir_len = strlen(current_directory);
-                size_t name_len = strlen(current_entries[index].name);
+                size_t name_len = strlen(entry->name);
                 
                 // Check if the combined path would fit
                 if (dir_len + name_len + 2 < sizeof(temp_path)) {
                     if (strcmp(current_directory, "/") == 0) {  // Changed from "/sdcard" to "/"
                         // SD card root case: "/<dirname>"
                         strcpy(temp_path, current_directory);
-                        strcat(temp_path, current_entries[index].name);
+                        strcat(temp_path, entry->name);
                     } else {
                         // Non-root directory case: "<directory>/<dirname>"
                         strcpy(temp_path, current_directory);
                         strcat(temp_path, "/");
-                        strcat(temp_path, current_entries[index].name);
+                        strcat(temp_path, entry->name);
                     }
                     
                     // Check if the path fits in current_directory
@@ -83,7 +85,7 @@ void back_button_event_handler(lv_event_t *e) {
         int screen_id = (int)(uintptr_t)lv_event_get_user_data(e);
         
         if (screen_id == 0) { // Reboot dialog back button
-            lv_screen_load(main_screen);
+            gui_screen_load(GUI_SCREEN_MAIN);
         } else if (screen_id == 1) { // File manager back button
             if (strcmp(current_directory, "/") != 0) {  // Changed from "/sdcard" to "/"
                 // Go up one directory
@@ -97,61 +99,93 @@ void back_button_event_handler(lv_event_t *e) {
                     update_file_list();
                 } else {
                     // Already at SD card root, go back to main screen
-                    lv_screen_load(main_screen);
+                    gui_screen_load(GUI_SCREEN_MAIN);
                 }
             } else {
                 // At SD card root, go back to main screen
-                lv_screen_load(main_screen);
+                gui_screen_load(GUI_SCREEN_MAIN);
             }
         } else if (screen_id == 2) { // Firmware loader back button
-            lv_screen_load(main_screen);
+            cancel_firmware_list_update();
+            gui_screen_load(GUI_SCREEN_MAIN);
         }
     }
 }
 
 void firmware_list_event_handler(lv_event_t *e) {
     if (lv_event_get_code(e) == LV_EVENT_CLICKED) {
-        uint32_t index = (uint32_t)(uintptr_t)lv_event_get_user_data(e);
+        size_t index = gui_vlist_get_item(e);
         
-        if (index < firmware_count) {
-            selected_firmware = index;
+        if (index < firmware_list_count(firmware_listing)) {
+            const firmware_info_t *firmware = firmware_list_get(firmware_listing, index);
+            ESP_LOGI(TAG, "Selected firmware: %s", firmware->filename);
+            
+            // Flashing would only fail after the confirmation, refuse here already
+            if (!firmware->compatible) {
+                selected_firmware = -1;
+                lv_obj_add_flag(flash_btn, LV_OBJ_FLAG_HIDDEN);
+                lv_label_set_text_fmt(status_label, "%s is not built for this chip", firmware->filename);
+                return;
+            }
+            
+            selected_firmware = (int)index;
             lv_obj_remove_flag(flash_btn, LV_OBJ_FLAG_HIDDEN);
-            ESP_LOGI(TAG, "Selected firmware: %s", firmware_files[index].filename);
+            if (firmware->project_name[0] != '\0') {
+                lv_label_set_text_fmt(status_label, "%s %s, IDF %s, built %s", firmware->project_name,
+                                      firmware->version, firmware->idf_version, firmware->build_date);
+            } else {
+                lv_label_set_text(status_label, "No app description in this image");
+            }
         }
     }
 }
 
+bool start_firmware_flash(const char *path) {
+    if (is_flashing_in_progress()) {
+        return false;
+    }
+    set_flashing_state(true);
+    
+    // Show progress screen
+    gui_screen_load(GUI_SCREEN_PROGRESS);
+    
+    // Create a copy of the firmware path for the task
+    char *firmware_path = strdup(path);
+    if (!firmware_path) {
+        set_flashing_state(false);
+        return false;
+    }
+    
+    // Start flashing task pinned to CPU1 to avoid conflicts with LVGL on CPU0
+    ESP_LOGI(TAG, "Starting firmware flashing task on CPU1 to avoid LVGL conflicts");
+    BaseType_t result = xTaskCreatePinnedToCore(
+        flash_firmware_task,    // Task function
+        "flash_task",          // Task name
+        8192,                  // Stack size
+        firmware_path,         // Task parameter
+        5,                     // Priority
+        NULL,                  // Task handle (not needed)
+        1                      // Pin to CPU1 (ESP32-P4 has cores 0 and 1)
+    );
+    
+    if (result != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create flashing task on CPU1");
+        // Cleanup and reset state
+        free(firmware_path);
+        set_flashing_state(false);
+        return false;
+    }
+    return true;
+}
+
 void flash_firmware_event_handler(lv_event_t *e) {
     if (lv_event_get_code(e) == LV_EVENT_CLICKED && selected_firmware >= 0 && !is_flashing_in_progress()) {
-        set_flashing_state(true);
         lv_obj_add_flag(flash_btn, LV_OBJ_FLAG_HIDDEN);
+        cancel_firmware_list_update();
         
-        // Show progress screen
-        lv_screen_load(progress_screen);
-        
-        // Create a copy of the firmware path for the task
-        char *firmware_path = malloc(strlen(firmware_files[selected_firmware].full_path) + 1);
-        strcpy(firmware_path, firmware_files[selected_firmware].full_path);
-        
-        // Start flashing task pinned to CPU1 to avoid conflicts with LVGL on CPU0
-        ESP_LOGI(TAG, "Starting firmware flashing task on CPU1 to avoid LVGL conflicts");
-        BaseType_t result = xTaskCreatePinnedToCore(
-            flash_firmware_task,    // Task function
-            "flash_task",          // Task name
-            8192,                  // Stack size
-            firmware_path,         // Task parameter
-            5,                     // Priority
-            NULL,                  // Task handle (not needed)
-            1                      // Pin to CPU1 (ESP32-P4 has cores 0 and 1)
-        );
-        
-        if (result != pdPASS) {
-            ESP_LOGE(TAG, "Failed to create flashing task on CPU1");
-            // Cleanup and reset state
-            free(firmware_path);
-            set_flashing_state(false);
+        if (!start_firmware_flash(firmware_list_get(firmware_listing, selected_firmware)->full_path)) {
             lv_obj_remove_flag(flash_btn, LV_OBJ_FLAG_HIDDEN);
-            lv_screen_load(firmware_loader_screen);
+            gui_screen_load(GUI_SCREEN_FIRMWARE_LOADER);
         }
     }
 }
@@ -161,8 +195,7 @@ void splash_button_event_handler(lv_event_t *e) {
         uint32_t choice = (uint32_t)(uintptr_t)lv_event_get_user_data(e);
         
         // Disable boot screen timeout
-        extern bool boot_screen_active;
-        boot_screen_active = false;
+        splash_cancel_boot_countdown();
         
         if (choice == 0) {
             // Configure firmware for boot and show manual reboot dialog
@@ -174,12 +207,12 @@ void splash_button_event_handler(lv_event_t *e) {
             } else {
                 ESP_LOGE(TAG, "Failed to configure firmware boot: %s", esp_err_to_name(ret));
                 // Stay on splash screen or go back to main
-                lv_screen_load(main_screen);
+                gui_screen_load(GUI_SCREEN_MAIN);
             }
         } else {
             // Stay in launcher
             ESP_LOGI(TAG, "User selected to stay in launcher");
-            lv_screen_load(main_screen);
+            gui_screen_load(GUI_SCREEN_MAIN);
         }
     }
 }
\ No newline at end of file
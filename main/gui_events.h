@@ -2,6 +2,7 @@
 #define GUI_EVENTS_H
 
 #include "lvgl.h"
+#include <stdbool.h>
 
 /**
  * @brief Main menu button event handler
@@ -23,6 +24,13 @@ void firmware_list_event_handler(lv_event_t *e);
  */
 void flash_firmware_event_handler(lv_event_t *e);
 
+/**
+ * @brief Show the progress screen and flash a firmware on a background task
+ * @param path Firmware path (relative to SD root), copied
+ * @return true if the flash task was started
+ */
+bool start_firmware_flash(const char *path);
+
 /**
  * @brief Back button event handler
  */
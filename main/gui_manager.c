@@ -3,12 +3,70 @@
 #include "gui_progress.h"
 #include "gui_state.h"
 #include "firmware_loader.h"
+#include "sd_manager.h"
 #include "esp_log.h"
 #include "esp_ota_ops.h"
 #include "esp_partition.h"
+#include "esp_lvgl_port.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/timers.h"
+#include <string.h>
 
 static const char *TAG = "GUI_MANAGER";
 
+#define GUI_QUEUE_LEN           8
+#define GUI_DRAIN_PERIOD_MS     1000    // Safety net, posts normally mark the drain ready
+#define GUI_POST_LOCK_MS        1       // At most a tick, 0 means wait forever to lvgl_port_lock()
+#define GUI_DEFER_LOCK_MS       500     // The timer task may wait, the drain timer covers a miss
+
+static QueueHandle_t gui_queue = NULL;
+static lv_timer_t *drain_timer = NULL;
+
+static void card_event_cb(sd_card_event_t event, void *user_data) {
+    gui_msg_t msg = { .type = GUI_MSG_CARD_CHANGED, .card = event };
+    gui_manager_post(&msg);
+}
+
+static void handle_card_change(sd_card_event_t event) {
+    ESP_LOGI(TAG, "SD card %s, refreshing screens", event == SD_CARD_INSERTED ? "inserted" : "removed");
+    gui_state_refresh_sd();
+    
+    // Lists on screen show the old card, a new card starts at its root
+    lv_obj_t *active = lv_screen_active();
+    if (active == file_manager_screen) {
+        strcpy(current_directory, "/");
+        update_file_list();
+    } else if (active == firmware_loader_screen) {
+        update_firmware_list();
+    }
+}
+
+static void handle_flash_finished(esp_err_t result) {
+    ESP_LOGI(TAG, "Flash finished (%s), back to the main screen", esp_err_to_name(result));
+    set_flashing_state(false);
+    gui_state_refresh_firmware(); // Only the widgets showing firmware status redraw
+    gui_screen_load(GUI_SCREEN_MAIN);
+}
+
+// Runs on the LVGL task, so handlers can use LVGL freely
+static void drain_timer_cb(lv_timer_t *timer) {
+    gui_msg_t msg;
+    while (xQueueReceive(gui_queue, &msg, 0) == pdTRUE) {
+        switch (msg.type) {
+            case GUI_MSG_FLASH_FINISHED:
+                handle_flash_finished(msg.result);
+                break;
+            case GUI_MSG_CARD_CHANGED:
+                handle_card_change(msg.card);
+                break;
+            default:
+                ESP_LOGW(TAG, "Unknown message %d", msg.type);
+                break;
+        }
+    }
+}
+
 esp_err_t gui_manager_init(lv_display_t *disp) {
     ESP_LOGI(TAG, "Initializing GUI Manager");
     
@@ -24,23 +82,61 @@ esp_err_t gui_manager_init(lv_display_t *disp) {
         }
     }
     
+    // Listings live in PSRAM and grow with the directory
+    esp_err_t ret = gui_state_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to allocate listings: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    
     // Initialize progress handling
     gui_progress_init();
     
-    // Create all screens
+    // Styles only, screens are built when first shown
     gui_screens_init();
     
-    // Always start with the main launcher screen
-    ESP_LOGI(TAG, "Starting with main launcher screen");
-    lv_screen_load(main_screen);
+    gui_queue = xQueueCreate(GUI_QUEUE_LEN, sizeof(gui_msg_t));
+    if (!gui_queue) {
+        ESP_LOGE(TAG, "Failed to create UI message queue");
+        return ESP_ERR_NO_MEM;
+    }
+    drain_timer = lv_timer_create(drain_timer_cb, GUI_DRAIN_PERIOD_MS, NULL);
     
+    if (sd_manager_add_card_callback(card_event_cb, NULL) != ESP_OK) {
+        ESP_LOGW(TAG, "SD card changes will not refresh the screens");
+    }
+    
+    // app_main loads the first screen, only that one is built before the first frame
     return ESP_OK;
 }
 
-void gui_manager_update(void) {
-    // Handle screen transitions and progress state
-    update_progress_ui();
+// Runs on the FreeRTOS timer task, which can wait for the display lock where posters cannot
+static void mark_drain_ready(void *arg, uint32_t unused) {
+    if (lvgl_port_lock(GUI_DEFER_LOCK_MS)) {
+        lv_timer_ready(drain_timer);
+        lvgl_port_unlock();
+    }
+    lvgl_port_task_wake(LVGL_PORT_EVENT_USER, NULL);
+}
+
+esp_err_t gui_manager_post(const gui_msg_t *msg) {
+    if (!gui_queue) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xQueueSend(gui_queue, msg, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "UI message queue full, dropping message %d", msg->type);
+        return ESP_FAIL;
+    }
     
-    // Process LVGL tasks
-    lv_timer_handler();
-}
\ No newline at end of file
+    // Only schedules the drain, the message itself is handled on the LVGL task.
+    // Posters must not block, so the lock is only tried; when the LVGL task
+    // holds it, the timer task marks the drain ready once the lock is free.
+    if (lvgl_port_lock(GUI_POST_LOCK_MS)) {
+        lv_timer_ready(drain_timer);
+        lvgl_port_unlock();
+        lvgl_port_task_wake(LVGL_PORT_EVENT_USER, NULL);
+    } else if (xTimerPendFunctionCall(mark_drain_ready, NULL, 0, 0) != pdPASS) {
+        ESP_LOGW(TAG, "Timer queue full, message %d waits for the next drain", msg->type);
+    }
+    return ESP_OK;
+}
@@ -3,17 +3,36 @@
 
 #include "lvgl.h"
 #include "esp_err.h"
+#include "sd_manager.h"
+
+// Messages from worker tasks to the LVGL task, which is the only one touching widgets
+typedef enum {
+    GUI_MSG_FLASH_FINISHED = 0,     // Flash task is done, its result is in .result
+    GUI_MSG_CARD_CHANGED,           // SD card inserted or removed, the event is in .card
+} gui_msg_type_t;
+
+typedef struct {
+    gui_msg_type_t type;
+    union {
+        esp_err_t result;
+        sd_card_event_t card;
+    };
+} gui_msg_t;
 
 /**
  * @brief Initialize GUI manager
+ * Call with the display lock held. LVGL then runs on the esp_lvgl_port task only.
  * @param disp LVGL display object
  * @return ESP_OK on success
  */
 esp_err_t gui_manager_init(lv_display_t *disp);
 
 /**
- * @brief Update GUI (call this in main loop)
+ * @brief Hand a message to the LVGL task
+ * Never blocks, callable from any task but the LVGL one, SD card callbacks included.
+ * @param msg Message, copied
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE before init, ESP_FAIL if the queue is full
  */
-void gui_manager_update(void);
+esp_err_t gui_manager_post(const gui_msg_t *msg);
 
-#endif // GUI_MANAGER_H
\ No newline at end of file
+#endif // GUI_MANAGER_H
@@ -1,31 +1,77 @@
 #include "gui_progress.h"
+#include "gui_manager.h"
 #include "gui_screens.h"
 #include "gui_state.h"
 #include "firmware_loader.h"
+#include "firmware_slots.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include <string.h>
 #include <stdlib.h>
+#include <stdatomic.h>
 
 static const char *TAG = "GUI_PROGRESS";
 
-// Flag to signal screen change from task
-static volatile bool should_show_splash = false;
-
 // Progress update timer
 static lv_timer_t *progress_timer = NULL;
 
-// Thread-safe progress data structure
+// Single-producer/single-consumer seqlock: the flashing task publishes, the LVGL
+// timer samples. The sequence is odd while a snapshot is being written.
+typedef struct {
+    atomic_uint seq;
+    atomic_size_t bytes_written;
+    atomic_size_t total_bytes;
+    atomic_int step;
+} progress_channel_t;
+
 typedef struct {
     size_t bytes_written;
     size_t total_bytes;
-    char step_description[128];
-    bool update_pending;
-} progress_data_t;
+    firmware_step_t step;
+} progress_snapshot_t;
+
+#define PROGRESS_READ_RETRIES 4
+
+static progress_channel_t progress_channel;
 
-static progress_data_t progress_data = {0};
-static portMUX_TYPE progress_mutex = portMUX_INITIALIZER_UNLOCKED;
+// Last state drawn by the timer, used to skip redundant LVGL updates
+static unsigned progress_drawn_seq = 0;
+static int32_t progress_drawn_percent = -1;
+static firmware_step_t progress_drawn_step = FIRMWARE_STEP_IDLE;
+
+static void progress_publish(size_t bytes_written, size_t total_bytes, firmware_step_t step) {
+    unsigned seq = atomic_load_explicit(&progress_channel.seq, memory_order_relaxed);
+    atomic_store_explicit(&progress_channel.seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&progress_channel.bytes_written, bytes_written, memory_order_relaxed);
+    atomic_store_explicit(&progress_channel.total_bytes, total_bytes, memory_order_relaxed);
+    atomic_store_explicit(&progress_channel.step, step, memory_order_relaxed);
+    atomic_store_explicit(&progress_channel.seq, seq + 2, memory_order_release);
+}
+
+// Returns false if nothing was published since last_seq or the producer kept racing us
+static bool progress_sample(unsigned last_seq, progress_snapshot_t *out, unsigned *out_seq) {
+    for (int i = 0; i < PROGRESS_READ_RETRIES; i++) {
+        unsigned begin = atomic_load_explicit(&progress_channel.seq, memory_order_acquire);
+        if (begin == last_seq) {
+            return false;
+        }
+        if (begin & 1) {
+            continue;
+        }
+        out->bytes_written = atomic_load_explicit(&progress_channel.bytes_written, memory_order_relaxed);
+        out->total_bytes = atomic_load_explicit(&progress_channel.total_bytes, memory_order_relaxed);
+        out->step = (firmware_step_t)atomic_load_explicit(&progress_channel.step, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&progress_channel.seq, memory_order_relaxed) == begin) {
+            *out_seq = begin;
+            return true;
+        }
+    }
+    // Try again on the next tick rather than spinning against the writer
+    return false;
+}
 
 // Timer callback for safe UI updates
 static void progress_timer_cb(lv_timer_t *timer) {
@@ -33,49 +79,47 @@ static void progress_timer_cb(lv_timer_t *timer) {
         return;
     }
     
-    // Safely copy progress data
-    progress_data_t local_data;
-    portENTER_CRITICAL(&progress_mutex);
-    if (!progress_data.update_pending) {
-        portEXIT_CRITICAL(&progress_mutex);
+    progress_snapshot_t snap;
+    if (!progress_sample(progress_drawn_seq, &snap, &progress_drawn_seq)) {
         return;
     }
-    local_data = progress_data;
-    progress_data.update_pending = false;
-    portEXIT_CRITICAL(&progress_mutex);
     
     // Update progress bar without animation to avoid conflicts
-    int32_t progress_percent = (local_data.total_bytes > 0) ? 
-        (local_data.bytes_written * 100 / local_data.total_bytes) : 0;
-    lv_bar_set_value(progress_bar, progress_percent, LV_ANIM_OFF);
+    int32_t progress_percent = (snap.total_bytes > 0) ? 
+        (int32_t)((uint64_t)snap.bytes_written * 100 / snap.total_bytes) : 0;
+    const char *step_description = firmware_loader_step_description(snap.step);
+    
+    if (progress_percent != progress_drawn_percent) {
+        lv_bar_set_value(progress_bar, progress_percent, LV_ANIM_OFF);
+    }
     
     // Update progress text
     char progress_text[128];
-    if (local_data.total_bytes > 0) {
+    if (snap.total_bytes > 0) {
         snprintf(progress_text, sizeof(progress_text), "%zu / %zu bytes (%ld%%)", 
-                local_data.bytes_written, local_data.total_bytes, progress_percent);
+                snap.bytes_written, snap.total_bytes, (long)progress_percent);
     } else {
-        snprintf(progress_text, sizeof(progress_text), "%s", local_data.step_description);
+        snprintf(progress_text, sizeof(progress_text), "%s", step_description);
     }
     lv_label_set_text(progress_label, progress_text);
     
-    // Update step description
-    lv_label_set_text(progress_step_label, local_data.step_description);
+    // Step text only changes a handful of times per flash
+    if (snap.step != progress_drawn_step) {
+        lv_label_set_text_static(progress_step_label, step_description);
+    }
+    
+    progress_drawn_percent = progress_percent;
+    progress_drawn_step = snap.step;
 }
 
 void gui_progress_init(void) {
-    progress_update_pending = false;
-    pending_bytes_written = 0;
-    pending_total_bytes = 0;
-    memset(pending_step_description, 0, sizeof(pending_step_description));
     flashing_in_progress = false;
-    should_show_splash = false;
-    should_show_main = false;
     
-    // Initialize progress data
-    portENTER_CRITICAL(&progress_mutex);
-    memset(&progress_data, 0, sizeof(progress_data));
-    portEXIT_CRITICAL(&progress_mutex);
+    // Start from an empty snapshot, nothing is publishing yet
+    progress_publish(0, 0, FIRMWARE_STEP_IDLE);
+    progress_drawn_seq = atomic_load_explicit(&progress_channel.seq, memory_order_relaxed);
+    progress_drawn_percent = -1;
+    progress_drawn_step = FIRMWARE_STEP_IDLE;
     
     // Create timer for progress updates (200ms interval)
     if (progress_timer == NULL) {
@@ -84,51 +128,8 @@ void gui_progress_init(void) {
     }
 }
 
-void update_progress_ui(void) {
-    // Handle screen transitions first
-    if (should_show_splash) {
-        should_show_splash = false;
-        lv_screen_load(splash_screen);
-        return;
-    }
-    
-    if (should_show_main) {
-        should_show_main = false;
-        lv_screen_load(main_screen);
-        
-        // Stop progress timer when leaving progress screen
-        if (progress_timer) {
-            lv_timer_pause(progress_timer);
-        }
-        return;
-    }
-    
-    // Start progress timer when flashing begins
-    if (flashing_in_progress && progress_timer) {
-        lv_timer_resume(progress_timer);
-    }
-}
-
-void firmware_progress_callback(size_t bytes_written, size_t total_bytes, const char *step_description) {
-    // Thread-safe update of progress data
-    portENTER_CRITICAL(&progress_mutex);
-    progress_data.bytes_written = bytes_written;
-    progress_data.total_bytes = total_bytes;
-    if (step_description) {
-        strncpy(progress_data.step_description, step_description, sizeof(progress_data.step_description) - 1);
-        progress_data.step_description[sizeof(progress_data.step_description) - 1] = '\0';
-    }
-    progress_data.update_pending = true;
-    portEXIT_CRITICAL(&progress_mutex);
-    
-    // Also update the legacy variables for compatibility
-    pending_bytes_written = bytes_written;
-    pending_total_bytes = total_bytes;
-    if (step_description) {
-        strncpy(pending_step_description, step_description, sizeof(pending_step_description) - 1);
-        pending_step_description[sizeof(pending_step_description) - 1] = '\0';
-    }
-    progress_update_pending = true;
+void firmware_progress_callback(size_t bytes_written, size_t total_bytes, firmware_step_t step) {
+    progress_publish(bytes_written, total_bytes, step);
 }
 
 void flash_firmware_task(void *pvParameters) {
@@ -136,22 +137,37 @@ void flash_firmware_task(void *pvParameters) {
     
     ESP_LOGI(TAG, "Starting firmware flash task for: %s", firmware_path);
     
+    // Nothing to write if the image is already in a slot, boot it right away
+    int installed_slot = firmware_loader_installed_slot(firmware_path);
+    if (installed_slot >= 0) {
+        ESP_LOGI(TAG, "Firmware already installed in slot %d, booting it directly", installed_slot);
+        firmware_progress_callback(100, 100, FIRMWARE_STEP_BOOTING_INSTALLED);
+        // The boot picks the most recently used slot, which need not be this one
+        esp_err_t boot_ret = firmware_slots_touch(installed_slot);
+        if (boot_ret == ESP_OK) {
+            boot_ret = firmware_loader_boot_firmware_once();
+        }
+        ESP_LOGE(TAG, "Failed to boot installed firmware: %s", esp_err_to_name(boot_ret));
+    }
+    
     esp_err_t ret = firmware_loader_flash_from_sd_with_progress(firmware_path, firmware_progress_callback);
     
     if (ret == ESP_OK) {
         // Flash successful - show completion message and return to main screen
         ESP_LOGI(TAG, "Firmware flash completed successfully");
-        firmware_progress_callback(100, 100, "Flash complete! Returning to launcher...");
+        firmware_progress_callback(100, 100, FIRMWARE_STEP_COMPLETE);
         vTaskDelay(pdMS_TO_TICKS(3000)); // Show completion message for 3 seconds
-        should_show_main = true;  // Return to main screen
     } else {
         ESP_LOGE(TAG, "Firmware flash failed with error: %s", esp_err_to_name(ret));
-        firmware_progress_callback(0, 100, "Flash failed!");
+        firmware_progress_callback(0, 100, ret == ESP_ERR_NOT_SUPPORTED ? FIRMWARE_STEP_WRONG_CHIP : FIRMWARE_STEP_FAILED);
         vTaskDelay(pdMS_TO_TICKS(3000));
-        should_show_main = true;  // Go back to main screen on failure
     }
     
-    set_flashing_state(false);
+    // The LVGL task clears the flashing state and returns to the main screen
+    gui_msg_t msg = { .type = GUI_MSG_FLASH_FINISHED, .result = ret };
+    if (gui_manager_post(&msg) != ESP_OK) {
+        ESP_LOGE(TAG, "Could not report the end of the flash to the UI");
+    }
     free(firmware_path);
     vTaskDelete(NULL);
 }
@@ -162,9 +178,14 @@ bool is_flashing_in_progress(void) {
 
 void set_flashing_state(bool state) {
     flashing_in_progress = state;
+    if (!progress_timer) {
+        return;
+    }
     
-    // Pause timer when flashing stops
-    if (!state && progress_timer) {
+    // The timer only samples progress while a flash is running
+    if (state) {
+        lv_timer_resume(progress_timer);
+    } else {
         lv_timer_pause(progress_timer);
     }
 }
\ No newline at end of file
@@ -4,21 +4,19 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include "lvgl.h"
+#include "firmware_loader.h"
 
 /**
  * @brief Initialize progress handling
  */
 void gui_progress_init(void);
 
-/**
- * @brief Update progress UI (call from main thread)
- */
-void update_progress_ui(void);
-
 /**
  * @brief Firmware progress callback (thread-safe)
+ * Publishes to a single-producer seqlock, so it never blocks or disables
+ * interrupts and can be called for every chunk. Only the flashing task may call it.
  */
-void firmware_progress_callback(size_t bytes_written, size_t total_bytes, const char *step_description);
+void firmware_progress_callback(size_t bytes_written, size_t total_bytes, firmware_step_t step);
 
 /**
  * @brief Flash firmware task
@@ -31,7 +29,8 @@ void flash_firmware_task(void *pvParameters);
 bool is_flashing_in_progress(void);
 
 /**
- * @brief Set flashing state
+ * @brief Set flashing state, LVGL task only
+ * Starts or stops the timer drawing the progress screen.
  */
 void set_flashing_state(bool state);
 
@@ -2,8 +2,12 @@
 #include "gui_events.h"
 #include "gui_state.h"
 #include "gui_styles.h"
+#include "gui_search.h"
+#include "gui_vlist.h"
 #include "sd_manager.h"
+#include "list_index.h"
 #include "esp_log.h"
+#include <stdio.h>
 #include <string.h>
 
 static const char *TAG = "GUI_FILE_MGR";
@@ -12,6 +16,74 @@ lv_obj_t *file_manager_screen = NULL;
 lv_obj_t *file_list = NULL;
 lv_obj_t *current_path_label = NULL;
 
+#define LIST_POLL_MS  20
+#define LIST_DONE_BIT BIT0
+
+// Directory reads run on the SD task into loading_listing, then swap with current_listing
+static sd_request_t list_request;
+static char list_path[512];
+static sd_listing_t *loading_listing = NULL;
+static EventGroupHandle_t list_events = NULL;
+static lv_timer_t *list_timer = NULL;
+static bool list_in_flight = false;
+
+// Sort orders the sort button cycles through
+static const struct {
+    const char *label;
+    list_sort_t sort;
+    bool descending;
+} file_sorts[] = {
+    { "Name", LIST_SORT_NAME, false },
+    { "Size", LIST_SORT_SIZE, true },
+    { "Date", LIST_SORT_DATE, true },
+    { "Unsorted", LIST_SORT_NONE, false },
+};
+
+static const char *const filter_labels[LIST_FILTER_COUNT] = { "All", "Folders", "Files", "Images" };
+
+// View of current_listing, the list shows its entries in view order
+static list_index_t *file_index = NULL;
+static lv_obj_t *search_box = NULL;
+static lv_obj_t *sort_label = NULL;
+static lv_obj_t *filter_label = NULL;
+static size_t file_sort = 0;
+static list_filter_t file_filter = LIST_FILTER_ALL;
+
+static void show_view(void);
+static void bind_file_row(size_t position, gui_vlist_row_t *row);
+
+static void search_changed_event_handler(lv_event_t *e) {
+    list_index_set_query(file_index, lv_textarea_get_text(search_box));
+    show_view();
+}
+
+static void sort_button_event_handler(lv_event_t *e) {
+    file_sort = (file_sort + 1) % (sizeof(file_sorts) / sizeof(file_sorts[0]));
+    lv_label_set_text(sort_label, file_sorts[file_sort].label);
+    list_index_set_sort(file_index, file_sorts[file_sort].sort, file_sorts[file_sort].descending);
+    show_view();
+}
+
+static void filter_button_event_handler(lv_event_t *e) {
+    file_filter = (file_filter + 1) % LIST_FILTER_COUNT;
+    lv_label_set_text(filter_label, filter_labels[file_filter]);
+    list_index_set_filter(file_index, file_filter);
+    show_view();
+}
+
+static lv_obj_t *create_tool_button(lv_obj_t *parent, int32_t x, lv_event_cb_t event_cb, const char *text) {
+    lv_obj_t *btn = lv_button_create(parent);
+    lv_obj_set_size(btn, lv_pct(20), 50);
+    lv_obj_align(btn, LV_ALIGN_TOP_LEFT, x, 105);
+    apply_button_style(btn);
+    lv_obj_add_event_cb(btn, event_cb, LV_EVENT_CLICKED, NULL);
+    
+    lv_obj_t *label = lv_label_create(btn);
+    lv_label_set_text(label, text);
+    lv_obj_center(label);
+    return label;
+}
+
 void create_file_manager_screen(void) {
     file_manager_screen = lv_obj_create(NULL);
     lv_obj_add_style(file_manager_screen, &style_screen, LV_PART_MAIN | LV_STATE_DEFAULT);
@@ -48,56 +120,155 @@ void create_file_manager_screen(void) {
     lv_label_set_text(back_label, LV_SYMBOL_LEFT " Back");
     lv_obj_center(back_label);
     
-    // Native LVGL list for files
-    file_list = lv_list_create(left_container);
+    // Search, sort and filter row
+    file_index = list_index_create();
+    list_index_set_sort(file_index, file_sorts[file_sort].sort, file_sorts[file_sort].descending);
+    list_index_set_filter(file_index, file_filter);
+    search_box = gui_search_create(left_container, file_manager_screen, search_changed_event_handler);
+    lv_obj_set_width(search_box, lv_pct(50));
+    lv_obj_align(search_box, LV_ALIGN_TOP_LEFT, 10, 105);
+    sort_label = create_tool_button(left_container, lv_pct(53), sort_button_event_handler, file_sorts[file_sort].label);
+    filter_label = create_tool_button(left_container, lv_pct(75), filter_button_event_handler, filter_labels[file_filter]);
+    
+    // Rows are recycled while scrolling, a directory of any size costs the same
+    file_list = gui_vlist_create(left_container, bind_file_row, file_list_event_handler);
     lv_obj_set_size(file_list, lv_pct(95), lv_pct(70));
     lv_obj_align(file_list, LV_ALIGN_BOTTOM_MID, 0, -10);
-    apply_list_style(file_list);
 }
 
-void update_file_list(void) {
-    // Clear existing items
-    lv_obj_clean(file_list);
+bool destroy_file_manager_screen(void) {
+    // The listing would land in a list that no longer exists
+    if (list_in_flight) {
+        return false;
+    }
+    lv_obj_delete(file_manager_screen);
+    file_manager_screen = NULL;
+    file_list = NULL;
+    current_path_label = NULL;
+    search_box = NULL;
+    sort_label = NULL;
+    filter_label = NULL;
+    list_index_destroy(file_index);
+    file_index = NULL;
+    return true;
+}
+
+static void bind_file_row(size_t position, gui_vlist_row_t *row) {
+    // Rows carry the listing index, which the click handler resolves
+    size_t i = list_index_get(file_index, position);
+    const file_entry_t *entry = sd_listing_get(current_listing, i);
+    row->item = i;
+    row->icon = entry->is_directory ? LV_SYMBOL_DIRECTORY : LV_SYMBOL_FILE;
+    row->color = entry->is_directory ? lv_color_hex(0x00ffff) : THEME_TEXT_COLOR;
+    // Too long for the row is cut with "..." by the label
+    snprintf(row->text, sizeof(row->text), "%s", entry->name);
+}
+
+static void show_view(void) {
+    size_t count = list_index_count(file_index);
+    if (count == 0) {
+        bool empty = sd_listing_count(current_listing) == 0;
+        gui_vlist_show_message(file_list, LV_SYMBOL_WARNING, empty ? "No files found" : "No matching files",
+                               THEME_WARNING_COLOR);
+        return;
+    }
+    gui_vlist_reset(file_list, count);
+}
+
+static void show_listing(int count) {
+    list_index_clear(file_index);
+    for (int i = 0; i < count; i++) {
+        const file_entry_t *entry = sd_listing_get(current_listing, i);
+        if (list_index_add(file_index, entry->name, entry->is_directory, entry->size, entry->mtime) != ESP_OK) {
+            ESP_LOGW(TAG, "Out of memory, view truncated at %d entries", i);
+            break;
+        }
+    }
+    show_view();
+}
+
+static void submit_listing(void) {
+    strcpy(list_path, current_directory);
+    list_request = (sd_request_t) {
+        .type = SD_REQUEST_LIST,
+        .path = list_path,
+        .list.listing = loading_listing,
+        .done_group = list_events,
+        .done_bits = LIST_DONE_BIT,
+    };
+    if (sd_manager_submit(&list_request, SD_PRIORITY_HIGH) != ESP_OK) {
+        gui_vlist_show_message(file_list, LV_SYMBOL_WARNING, "Failed to read SD card", THEME_ERROR_COLOR);
+        return;
+    }
+    list_in_flight = true;
+    lv_timer_resume(list_timer);
+}
+
+static void list_timer_cb(lv_timer_t *timer) {
+    if (!(xEventGroupGetBits(list_events) & LIST_DONE_BIT)) {
+        return;
+    }
+    xEventGroupClearBits(list_events, LIST_DONE_BIT);
+    list_in_flight = false;
     
-    // Update path label
-    lv_label_set_text(current_path_label, current_directory);
+    // The user navigated while this directory was being read
+    if (strcmp(list_path, current_directory) != 0) {
+        submit_listing();
+        return;
+    }
+    lv_timer_pause(list_timer);
     
-    if (!sd_manager_is_mounted()) {
-        lv_obj_t *item = lv_list_add_button(file_list, LV_SYMBOL_WARNING, "SD Card not mounted");
-        lv_obj_set_style_text_color(item, THEME_ERROR_COLOR, 0);
+    // A failed read leaves loading_listing as it was, the previous directory is dropped instead
+    if (list_request.result != ESP_OK) {
+        sd_listing_clear(current_listing);
+        list_index_clear(file_index);
+        gui_vlist_show_message(file_list, LV_SYMBOL_WARNING, "Failed to read SD card", THEME_ERROR_COLOR);
         return;
     }
     
-    file_entry_t entries[32];
-    int count = sd_manager_scan_directory(current_directory, entries, 32);
+    // The finished listing becomes the one the click handler indexes
+    sd_listing_t *listing = current_listing;
+    current_listing = loading_listing;
+    loading_listing = listing;
+    show_listing(list_request.list.count);
+}
+
+void update_file_list(void) {
+    // A search is for one directory, start the next one unfiltered
+    if (lv_textarea_get_text(search_box)[0] != '\0') {
+        lv_textarea_set_text(search_box, "");
+    }
+    
+    // Update path label
+    lv_label_set_text(current_path_label, current_directory);
     
-    if (count <= 0) {
-        lv_obj_t *item = lv_list_add_button(file_list, LV_SYMBOL_WARNING, "No files found");
-        lv_obj_set_style_text_color(item, THEME_WARNING_COLOR, 0);
+    if (!sd_manager_is_mounted()) {
+        gui_vlist_show_message(file_list, LV_SYMBOL_WARNING, "SD Card not mounted", THEME_ERROR_COLOR);
         return;
     }
     
-    for (int i = 0; i < count; i++) {
-        const char *icon = entries[i].is_directory ? LV_SYMBOL_DIRECTORY : LV_SYMBOL_FILE;
-        
-        // Truncate filename if too long
-        char truncated_name[200];
-        if (strlen(entries[i].name) > 190) {
-            strncpy(truncated_name, entries[i].name, 187);
-            truncated_name[187] = '\0';
-            strcat(truncated_name, "...");
-        } else {
-            strcpy(truncated_name, entries[i].name);
+    if (!list_timer) {
+        // Whatever was allocated is kept for the next attempt
+        if (!loading_listing) {
+            loading_listing = sd_listing_create();
+        }
+        if (!list_events) {
+            list_events = xEventGroupCreate();
+        }
+        if (loading_listing && list_events) {
+            list_timer = lv_timer_create(list_timer_cb, LIST_POLL_MS, NULL);
         }
-        
-        lv_obj_t *item = lv_list_add_button(file_list, icon, truncated_name);
-        apply_list_item_style(item);
-        lv_obj_add_event_cb(item, file_list_event_handler, LV_EVENT_CLICKED, (void*)(uintptr_t)i);
-        
-        if (entries[i].is_directory) {
-            lv_obj_set_style_text_color(item, lv_color_hex(0x00ffff), 0);
-        } else {
-            lv_obj_set_style_text_color(item, THEME_TEXT_COLOR, 0);
+        if (!list_timer) {
+            ESP_LOGE(TAG, "Out of memory, cannot read directories");
+            gui_vlist_show_message(file_list, LV_SYMBOL_WARNING, "Out of memory", THEME_ERROR_COLOR);
+            return;
         }
+        lv_timer_pause(list_timer);
     }
-}
\ No newline at end of file
+    
+    // Read on the SD task, the timer shows the result once it arrives
+    gui_vlist_show_message(file_list, LV_SYMBOL_REFRESH, "Loading...", THEME_TEXT_COLOR);
+    if (!list_in_flight) {
+        submit_listing();
+    }
+}
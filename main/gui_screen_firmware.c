@@ -2,8 +2,14 @@
 #include "gui_events.h"
 #include "gui_state.h"
 #include "gui_styles.h"
+#include "gui_search.h"
+#include "gui_vlist.h"
 #include "sd_manager.h"
+#include "list_index.h"
 #include "firmware_loader.h"
+#include "firmware_discovery.h"
+#include "firmware_image.h"
+#include "sdkconfig.h"
 #include "esp_log.h"
 #include <string.h>
 
@@ -14,6 +20,45 @@ lv_obj_t *firmware_list = NULL;
 lv_obj_t *flash_btn = NULL;
 lv_obj_t *status_label = NULL;
 
+#define DISCOVERY_POLL_MS 100
+
+// Moves discovery results into the list while a search runs
+static lv_timer_t *discovery_timer = NULL;
+
+// Sort orders the sort button cycles through
+static const struct {
+    const char *label;
+    list_sort_t sort;
+    bool descending;
+} firmware_sorts[] = {
+    { "Found", LIST_SORT_NONE, false },     // Discovery order, nearest to the root first
+    { "Name", LIST_SORT_NAME, false },
+    { "Size", LIST_SORT_SIZE, true },
+};
+
+// View of firmware_listing, the list shows its entries in view order
+static list_index_t *firmware_index = NULL;
+static lv_obj_t *search_box = NULL;
+static lv_obj_t *sort_label = NULL;
+static size_t firmware_sort = 0;
+// Set once an entry misses the index, later ones would sit at the wrong listing position
+static bool firmware_index_full = false;
+
+static void show_firmware_view(void);
+static void bind_firmware_row(size_t position, gui_vlist_row_t *row);
+
+static void search_changed_event_handler(lv_event_t *e) {
+    list_index_set_query(firmware_index, lv_textarea_get_text(search_box));
+    show_firmware_view();
+}
+
+static void sort_button_event_handler(lv_event_t *e) {
+    firmware_sort = (firmware_sort + 1) % (sizeof(firmware_sorts) / sizeof(firmware_sorts[0]));
+    lv_label_set_text(sort_label, firmware_sorts[firmware_sort].label);
+    list_index_set_sort(firmware_index, firmware_sorts[firmware_sort].sort, firmware_sorts[firmware_sort].descending);
+    show_firmware_view();
+}
+
 void create_firmware_loader_screen(void) {
     firmware_loader_screen = lv_obj_create(NULL);
     lv_obj_add_style(firmware_loader_screen, &style_screen, LV_PART_MAIN | LV_STATE_DEFAULT);
@@ -43,11 +88,27 @@ void create_firmware_loader_screen(void) {
     lv_label_set_text(back_label, LV_SYMBOL_LEFT " Back");
     lv_obj_center(back_label);
     
-    // Native LVGL list for firmware files
-    firmware_list = lv_list_create(left_container);
-    lv_obj_set_size(firmware_list, lv_pct(95), lv_pct(60));
-    lv_obj_align(firmware_list, LV_ALIGN_TOP_MID, 0, 90);
-    apply_list_style(firmware_list);
+    // Search and sort row
+    firmware_index = list_index_create();
+    list_index_set_sort(firmware_index, firmware_sorts[firmware_sort].sort, firmware_sorts[firmware_sort].descending);
+    search_box = gui_search_create(left_container, firmware_loader_screen, search_changed_event_handler);
+    lv_obj_set_width(search_box, lv_pct(70));
+    lv_obj_align(search_box, LV_ALIGN_TOP_LEFT, 10, 95);
+    
+    lv_obj_t *sort_btn = lv_button_create(left_container);
+    lv_obj_set_size(sort_btn, lv_pct(22), 50);
+    lv_obj_align(sort_btn, LV_ALIGN_TOP_RIGHT, -10, 95);
+    apply_button_style(sort_btn);
+    lv_obj_add_event_cb(sort_btn, sort_button_event_handler, LV_EVENT_CLICKED, NULL);
+    
+    sort_label = lv_label_create(sort_btn);
+    lv_label_set_text(sort_label, firmware_sorts[firmware_sort].label);
+    lv_obj_center(sort_label);
+    
+    // Rows are recycled while scrolling, however many images the search finds
+    firmware_list = gui_vlist_create(left_container, bind_firmware_row, firmware_list_event_handler);
+    lv_obj_set_size(firmware_list, lv_pct(95), lv_pct(55));
+    lv_obj_align(firmware_list, LV_ALIGN_TOP_MID, 0, 155);
     
     // Flash button
     flash_btn = lv_button_create(left_container);
@@ -69,51 +130,155 @@ void create_firmware_loader_screen(void) {
     lv_obj_align(status_label, LV_ALIGN_BOTTOM_MID, 0, -20);
 }
 
+bool destroy_firmware_loader_screen(void) {
+    cancel_firmware_list_update();
+    lv_obj_delete(firmware_loader_screen);
+    firmware_loader_screen = NULL;
+    firmware_list = NULL;
+    flash_btn = NULL;
+    status_label = NULL;
+    search_box = NULL;
+    sort_label = NULL;
+    list_index_destroy(firmware_index);
+    firmware_index = NULL;
+    return true;
+}
+
+static void bind_firmware_row(size_t position, gui_vlist_row_t *row) {
+    size_t index = list_index_get(firmware_index, position);
+    const firmware_info_t *firmware = firmware_list_get(firmware_listing, index);
+    
+    // Files below the root show their directory as well
+    const char *display_name = firmware->full_path[0] == '/' ? firmware->full_path + 1 : firmware->full_path;
+    
+    // Truncate filename if too long
+    char truncated_name[224];
+    if (strlen(display_name) > 180) {
+        strncpy(truncated_name, display_name, 177);
+        truncated_name[177] = '\0';
+        strcat(truncated_name, "...");
+    } else {
+        strcpy(truncated_name, display_name);
+    }
+    
+    // App version from the catalog, when the image has a descriptor
+    if (firmware->version[0] != '\0') {
+        size_t len = strlen(truncated_name);
+        snprintf(truncated_name + len, sizeof(truncated_name) - len, " [%s]", firmware->version);
+    }
+    
+    // Images for other chips stay visible so the user knows why they cannot be flashed
+    if (!firmware->compatible) {
+        size_t len = strlen(truncated_name);
+        if (firmware->chip_id != CONFIG_IDF_FIRMWARE_CHIP_ID) {
+            snprintf(truncated_name + len, sizeof(truncated_name) - len, " (%s image)",
+                     firmware_image_chip_name(firmware->chip_id));
+        } else {
+            snprintf(truncated_name + len, sizeof(truncated_name) - len, " (other chip revision)");
+        }
+    }
+    
+    size_t size_kb = firmware->size / 1024;
+    size_t image_kb = firmware->image_size / 1024;
+    if (size_kb > 9999) {
+        snprintf(row->text, sizeof(row->text), "%s (>9MB)", truncated_name);
+    } else if (firmware->image_size != firmware->size) {
+        // Compressed image, show what is read from the card and what gets flashed
+        snprintf(row->text, sizeof(row->text), "%s (%zuKB -> %zuKB)", truncated_name, size_kb, image_kb);
+    } else {
+        snprintf(row->text, sizeof(row->text), "%s (%zuKB)", truncated_name, size_kb);
+    }
+    
+    row->item = index;
+    row->icon = LV_SYMBOL_FILE;
+    if (!firmware->compatible) {
+        row->color = THEME_ERROR_COLOR;
+    }
+}
+
+static void show_firmware_view(void) {
+    size_t count = list_index_count(firmware_index);
+    if (count == 0 && firmware_list_count(firmware_listing) > 0) {
+        gui_vlist_show_message(firmware_list, LV_SYMBOL_WARNING, "No matching firmware", THEME_WARNING_COLOR);
+        return;
+    }
+    gui_vlist_reset(firmware_list, count);
+}
+
+static void discovery_timer_cb(lv_timer_t *timer) {
+    size_t first = firmware_list_count(firmware_listing);
+    bool done;
+    firmware_discovery_poll(firmware_listing, &done);
+    
+    size_t count = firmware_list_count(firmware_listing);
+    for (size_t i = first; i < count && !firmware_index_full; i++) {
+        const firmware_info_t *firmware = firmware_list_get(firmware_listing, i);
+        if (list_index_add(firmware_index, firmware->full_path, false, firmware->size, 0) != ESP_OK) {
+            ESP_LOGW(TAG, "Out of memory, view truncated at %u entries", (unsigned)i);
+            firmware_index_full = true;
+        }
+    }
+    
+    // Arrivals go to the end of an unsorted, unfiltered list, anything else is rebound
+    if (count > first) {
+        size_t shown = list_index_count(firmware_index);
+        if (list_index_is_identity(firmware_index)) {
+            gui_vlist_set_count(firmware_list, shown);
+        } else if (shown == 0) {
+            show_firmware_view();
+        } else {
+            gui_vlist_refresh(firmware_list, shown);
+        }
+    }
+    
+    if (!done) {
+        if (count > first) {
+            lv_label_set_text_fmt(status_label, "Searching... %u found", (unsigned)count);
+        }
+        return;
+    }
+    
+    lv_timer_pause(discovery_timer);
+    if (count == 0) {
+        gui_vlist_show_message(firmware_list, LV_SYMBOL_WARNING, "No firmware files found", THEME_WARNING_COLOR);
+        lv_label_set_text(status_label, "No .bin or .bin.gz files found on SD card");
+    } else {
+        lv_label_set_text(status_label, "Select a firmware file to flash");
+    }
+}
+
 void update_firmware_list(void) {
     // Clear existing items
-    lv_obj_clean(firmware_list);
+    firmware_list_clear(firmware_listing);
+    list_index_clear(firmware_index);
+    firmware_index_full = false;
+    gui_vlist_reset(firmware_list, 0);
     selected_firmware = -1;
     lv_obj_add_flag(flash_btn, LV_OBJ_FLAG_HIDDEN);
     
     if (!sd_manager_is_mounted()) {
-        lv_obj_t *item = lv_list_add_button(firmware_list, LV_SYMBOL_WARNING, "SD Card not mounted");
-        lv_obj_set_style_text_color(item, THEME_ERROR_COLOR, 0);
+        gui_vlist_show_message(firmware_list, LV_SYMBOL_WARNING, "SD Card not mounted", THEME_ERROR_COLOR);
         lv_label_set_text(status_label, "SD Card not available");
         return;
     }
     
-    firmware_count = firmware_loader_scan_firmware_files("/", firmware_files, 16);
-    
-    if (firmware_count <= 0) {
-        lv_obj_t *item = lv_list_add_button(firmware_list, LV_SYMBOL_WARNING, "No firmware files found");
-        lv_obj_set_style_text_color(item, THEME_WARNING_COLOR, 0);
-        lv_label_set_text(status_label, "No .bin files found on SD card");
+    // The card is walked in the background, the timer adds items as they arrive
+    if (firmware_discovery_start("/", CONFIG_LAUNCHER_DISCOVERY_DEPTH) != ESP_OK) {
+        gui_vlist_show_message(firmware_list, LV_SYMBOL_WARNING, "Failed to search SD card", THEME_ERROR_COLOR);
         return;
     }
+    lv_label_set_text(status_label, "Searching for firmware...");
     
-    for (int i = 0; i < firmware_count; i++) {
-        // Truncate filename if too long
-        char truncated_name[200];
-        if (strlen(firmware_files[i].filename) > 180) {
-            strncpy(truncated_name, firmware_files[i].filename, 177);
-            truncated_name[177] = '\0';
-            strcat(truncated_name, "...");
-        } else {
-            strcpy(truncated_name, firmware_files[i].filename);
-        }
-        
-        char item_text[256];
-        size_t size_kb = firmware_files[i].size / 1024;
-        if (size_kb > 9999) {
-            snprintf(item_text, sizeof(item_text), "%s (>9MB)", truncated_name);
-        } else {
-            snprintf(item_text, sizeof(item_text), "%s (%zuKB)", truncated_name, size_kb);
-        }
-        
-        lv_obj_t *item = lv_list_add_button(firmware_list, LV_SYMBOL_FILE, item_text);
-        apply_list_item_style(item);
-        lv_obj_add_event_cb(item, firmware_list_event_handler, LV_EVENT_CLICKED, (void*)(uintptr_t)i);
+    if (!discovery_timer) {
+        discovery_timer = lv_timer_create(discovery_timer_cb, DISCOVERY_POLL_MS, NULL);
+    } else {
+        lv_timer_resume(discovery_timer);
     }
-    
-    lv_label_set_text(status_label, "Select a firmware file to flash");
-}
\ No newline at end of file
+}
+
+void cancel_firmware_list_update(void) {
+    firmware_discovery_cancel();
+    if (discovery_timer) {
+        lv_timer_pause(discovery_timer);
+    }
+}
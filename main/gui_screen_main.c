@@ -1,14 +1,59 @@
 #include "gui_screens.h"
 #include "gui_events.h"
 #include "gui_styles.h"
-#include "sd_manager.h"
+#include "gui_state.h"
 #include "firmware_loader.h"
+#include "flash_journal.h"
 #include "esp_log.h"
+#include <stdio.h>
+#include <string.h>
 
 static const char *TAG = "GUI_MAIN";
 
 lv_obj_t *main_screen = NULL;
 
+static lv_obj_t *resume_dialog = NULL;
+static char resume_path[MAX_FIRMWARE_PATH_LEN];
+
+static void resume_dialog_event_handler(lv_event_t *e) {
+    if (lv_event_get_code(e) == LV_EVENT_CLICKED) {
+        bool resume = (bool)(uintptr_t)lv_event_get_user_data(e);
+        
+        lv_msgbox_close(resume_dialog);
+        resume_dialog = NULL;
+        
+        if (resume) {
+            ESP_LOGI(TAG, "Resuming flash of %s", resume_path);
+            start_firmware_flash(resume_path);
+        } else {
+            ESP_LOGI(TAG, "Discarding interrupted flash of %s", resume_path);
+            flash_journal_clear();
+        }
+    }
+}
+
+static void sd_status_observer_cb(lv_observer_t *observer, lv_subject_t *subject) {
+    lv_obj_t *sd_status = lv_observer_get_target_obj(observer);
+    if (lv_subject_get_int(subject)) {
+        lv_label_set_text(sd_status, LV_SYMBOL_SD_CARD " SD Card: Mounted");
+        lv_obj_set_style_text_color(sd_status, THEME_SUCCESS_COLOR, 0);
+    } else {
+        lv_label_set_text(sd_status, LV_SYMBOL_SD_CARD " SD Card: Not Found");
+        lv_obj_set_style_text_color(sd_status, THEME_ERROR_COLOR, 0);
+    }
+}
+
+static void run_label_observer_cb(lv_observer_t *observer, lv_subject_t *subject) {
+    lv_obj_t *run_fw_label = lv_observer_get_target_obj(observer);
+    if (lv_subject_get_int(subject)) {
+        lv_label_set_text(run_fw_label, LV_SYMBOL_PLAY " Run Firmware");
+        lv_obj_set_style_text_color(run_fw_label, THEME_SUCCESS_COLOR, 0);
+    } else {
+        lv_label_set_text(run_fw_label, LV_SYMBOL_CLOSE " No Firmware");
+        lv_obj_set_style_text_color(run_fw_label, THEME_ERROR_COLOR, 0);
+    }
+}
+
 void create_main_screen(void) {
     main_screen = lv_obj_create(NULL);
     lv_obj_add_style(main_screen, &style_screen, LV_PART_MAIN | LV_STATE_DEFAULT);
@@ -27,15 +72,9 @@ void create_main_screen(void) {
     apply_title_style(title);
     lv_obj_align(title, LV_ALIGN_TOP_MID, 0, 20);
     
-    // SD Card status
+    // SD Card status, follows insertion and removal
     lv_obj_t *sd_status = lv_label_create(left_container);
-    if (sd_manager_is_mounted()) {
-        lv_label_set_text(sd_status, LV_SYMBOL_SD_CARD " SD Card: Mounted");
-        lv_obj_set_style_text_color(sd_status, THEME_SUCCESS_COLOR, 0);
-    } else {
-        lv_label_set_text(sd_status, LV_SYMBOL_SD_CARD " SD Card: Not Found");
-        lv_obj_set_style_text_color(sd_status, THEME_ERROR_COLOR, 0);
-    }
+    lv_subject_add_observer_obj(&sd_mounted_subject, sd_status_observer_cb, sd_status, NULL);
     lv_obj_set_style_text_font(sd_status, THEME_FONT_NORMAL, 0);
     lv_obj_align(sd_status, LV_ALIGN_TOP_MID, 0, 70);
     
@@ -68,23 +107,40 @@ void create_main_screen(void) {
     apply_button_style(run_fw_btn);
     lv_obj_add_event_cb(run_fw_btn, main_menu_event_handler, LV_EVENT_CLICKED, (void*)(uintptr_t)2);
     
+    // Enabled while a firmware is installed, follows flashing
     lv_obj_t *run_fw_label = lv_label_create(run_fw_btn);
-    
-    // Check if firmware is available
-    if (firmware_loader_is_firmware_ready()) {
-        lv_label_set_text(run_fw_label, LV_SYMBOL_PLAY " Run Firmware");
-        lv_obj_set_style_text_color(run_fw_label, THEME_SUCCESS_COLOR, 0);
-    } else {
-        lv_label_set_text(run_fw_label, LV_SYMBOL_CLOSE " No Firmware");
-        lv_obj_set_style_text_color(run_fw_label, THEME_ERROR_COLOR, 0);
-        lv_obj_add_state(run_fw_btn, LV_STATE_DISABLED);
-    }
+    lv_subject_add_observer_obj(&firmware_ready_subject, run_label_observer_cb, run_fw_label, NULL);
+    lv_obj_bind_state_if_eq(run_fw_btn, &firmware_ready_subject, LV_STATE_DISABLED, 0);
     lv_obj_center(run_fw_label);
+    
+    // Firmware the Run button boots
+    lv_obj_t *installed_label = lv_label_create(left_container);
+    lv_label_bind_text(installed_label, &installed_firmware_subject, NULL);
+    apply_text_muted_style(installed_label);
+    lv_obj_align(installed_label, LV_ALIGN_CENTER, 0, 145);
 }
 
-void update_main_screen(void) {
-    if (main_screen) {
-        lv_obj_clean(main_screen);
-        create_main_screen();
+void show_resume_flash_dialog(const char *firmware_path, size_t committed, size_t total) {
+    if (resume_dialog) {
+        return;
     }
-}
\ No newline at end of file
+    strncpy(resume_path, firmware_path, sizeof(resume_path) - 1);
+    resume_path[sizeof(resume_path) - 1] = '\0';
+    
+    const char *name = strrchr(firmware_path, '/');
+    char text[MAX_FIRMWARE_PATH_LEN + 96];
+    snprintf(text, sizeof(text), "Flashing %s was interrupted at %zu%%.\nResume from the last verified block?",
+             name ? name + 1 : firmware_path, total ? committed * 100 / total : 0);
+    
+    resume_dialog = lv_msgbox_create(NULL);
+    lv_msgbox_add_title(resume_dialog, LV_SYMBOL_WARNING " Interrupted Flash");
+    lv_msgbox_add_text(resume_dialog, text);
+    
+    lv_obj_t *resume_btn = lv_msgbox_add_footer_button(resume_dialog, "Resume");
+    apply_button_style(resume_btn);
+    lv_obj_add_event_cb(resume_btn, resume_dialog_event_handler, LV_EVENT_CLICKED, (void*)(uintptr_t)true);
+    
+    lv_obj_t *discard_btn = lv_msgbox_add_footer_button(resume_dialog, "Discard");
+    apply_button_style(discard_btn);
+    lv_obj_add_event_cb(discard_btn, resume_dialog_event_handler, LV_EVENT_CLICKED, (void*)(uintptr_t)false);
+}
@@ -52,4 +52,13 @@ void create_progress_screen(void) {
     lv_obj_set_style_text_color(progress_step_label, THEME_SUCCESS_COLOR, 0);
     lv_obj_set_style_text_font(progress_step_label, THEME_FONT_NORMAL, 0);
     lv_obj_align(progress_step_label, LV_ALIGN_CENTER, 0, -50);
-}
\ No newline at end of file
+}
+
+bool destroy_progress_screen(void) {
+    lv_obj_delete(progress_screen);
+    progress_screen = NULL;
+    progress_bar = NULL;
+    progress_label = NULL;
+    progress_step_label = NULL;
+    return true;
+}
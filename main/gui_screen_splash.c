@@ -8,15 +8,38 @@ static const char *TAG = "GUI_SPLASH";
 
 lv_obj_t *splash_screen = NULL;
 
+static lv_timer_t *boot_countdown = NULL;
+
+static void boot_countdown_cb(lv_timer_t *timer) {
+    // One-shot timers delete themselves after this callback
+    boot_countdown = NULL;
+    ESP_LOGI(TAG, "Boot screen timeout, auto-booting firmware");
+    esp_err_t ret = firmware_loader_boot_firmware_once();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure firmware boot: %s", esp_err_to_name(ret));
+    }
+}
+
+void splash_start_boot_countdown(uint32_t timeout_ms) {
+    splash_cancel_boot_countdown();
+    boot_countdown = lv_timer_create(boot_countdown_cb, timeout_ms, NULL);
+    lv_timer_set_repeat_count(boot_countdown, 1);
+}
+
+void splash_cancel_boot_countdown(void) {
+    if (boot_countdown) {
+        lv_timer_delete(boot_countdown);
+        boot_countdown = NULL;
+    }
+}
+
 // Event handler for the background tap
 static void splash_background_event_handler(lv_event_t *e) {
     if (lv_event_get_code(e) == LV_EVENT_CLICKED) {
         // Boot firmware when tapping anywhere on the background
         ESP_LOGI(TAG, "Background tapped - booting firmware");
         
-        // Disable boot screen timeout
-        extern bool boot_screen_active;
-        boot_screen_active = false;
+        splash_cancel_boot_countdown();
         
         esp_err_t ret = firmware_loader_boot_firmware_once();
         if (ret != ESP_OK) {
@@ -63,4 +86,11 @@ void create_splash_screen(void) {
     lv_obj_t *launcher_label = lv_label_create(launcher_btn);
     lv_label_set_text(launcher_label, LV_SYMBOL_SETTINGS " Enter Launcher");
     lv_obj_center(launcher_label);
-}
\ No newline at end of file
+}
+
+bool destroy_splash_screen(void) {
+    splash_cancel_boot_countdown();
+    lv_obj_delete(splash_screen);
+    splash_screen = NULL;
+    return true;
+}
@@ -1,18 +1,110 @@
 #include "gui_screens.h"
 #include "gui_styles.h"
+#include "gui_progress.h"
+#include "sdkconfig.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 static const char *TAG = "GUI_SCREENS";
 
+#define PREFETCH_DELAY_MS 300   // Long enough for the shown screen to reach the display first
+
+typedef struct {
+    const char *name;
+    lv_obj_t **screen;
+    void (*create)(void);
+    bool (*destroy)(void);      // NULL if never reclaimed, returns false while the screen is busy
+    int likely_next;            // Screen to prefetch once this one is shown, -1 for none
+    uint32_t last_shown;        // lv_tick_get() of the last load
+} screen_entry_t;
+
+static screen_entry_t screens[GUI_SCREEN_COUNT] = {
+    [GUI_SCREEN_MAIN]            = { "main", &main_screen, create_main_screen, NULL,
+                                     GUI_SCREEN_FIRMWARE_LOADER },
+    [GUI_SCREEN_FILE_MANAGER]    = { "file manager", &file_manager_screen, create_file_manager_screen,
+                                     destroy_file_manager_screen, -1 },
+    [GUI_SCREEN_FIRMWARE_LOADER] = { "firmware loader", &firmware_loader_screen, create_firmware_loader_screen,
+                                     destroy_firmware_loader_screen, GUI_SCREEN_PROGRESS },
+    [GUI_SCREEN_PROGRESS]        = { "progress", &progress_screen, create_progress_screen,
+                                     destroy_progress_screen, -1 },
+    [GUI_SCREEN_SPLASH]          = { "splash", &splash_screen, create_splash_screen,
+                                     destroy_splash_screen, GUI_SCREEN_MAIN },
+};
+
 void gui_screens_init(void) {
     ESP_LOGI(TAG, "Initializing GUI styles");
     gui_styles_init();
     
-    ESP_LOGI(TAG, "Initializing all GUI screens");
-    create_main_screen();
-    create_file_manager_screen();
-    create_firmware_loader_screen();
-    create_progress_screen();
-    create_splash_screen();
-    ESP_LOGI(TAG, "All GUI screens initialized");
-}
\ No newline at end of file
+    // Screens are built by gui_screen_get() when first needed
+}
+
+lv_obj_t *gui_screen_get(gui_screen_id_t id) {
+    screen_entry_t *entry = &screens[id];
+    if (!*entry->screen) {
+        int64_t start = esp_timer_get_time();
+        entry->create();
+        ESP_LOGI(TAG, "Built %s screen in %lld us", entry->name, (long long)(esp_timer_get_time() - start));
+    }
+    return *entry->screen;
+}
+
+static void reclaim_cold_screens(void *arg) {
+    // The progress timer draws into its screen until the flash is over
+    if (is_flashing_in_progress()) {
+        return;
+    }
+    
+    lv_mem_monitor_t mon;
+    lv_mem_monitor(&mon);
+    uint32_t tried = 0;
+    while (mon.used_pct > CONFIG_LAUNCHER_SCREEN_RECLAIM_PCT) {
+        // Least recently shown first, never the one on the display
+        int coldest = -1;
+        for (int i = 0; i < GUI_SCREEN_COUNT; i++) {
+            screen_entry_t *entry = &screens[i];
+            if (!entry->destroy || !*entry->screen || *entry->screen == lv_screen_active() || (tried & (1u << i))) {
+                continue;
+            }
+            if (coldest < 0 || entry->last_shown < screens[coldest].last_shown) {
+                coldest = i;
+            }
+        }
+        if (coldest < 0) {
+            break;
+        }
+        
+        tried |= 1u << coldest;
+        if (screens[coldest].destroy()) {
+            ESP_LOGI(TAG, "Reclaimed %s screen at %u%% LVGL heap use", screens[coldest].name, (unsigned)mon.used_pct);
+            lv_mem_monitor(&mon);
+        }
+    }
+}
+
+static void prefetch_timer_cb(lv_timer_t *timer) {
+    gui_screen_get((gui_screen_id_t)(uintptr_t)lv_timer_get_user_data(timer));
+}
+
+static void prefetch(int id) {
+#if CONFIG_LAUNCHER_SCREEN_PREFETCH
+    if (id < 0 || *screens[id].screen) {
+        return;
+    }
+    lv_timer_t *timer = lv_timer_create(prefetch_timer_cb, PREFETCH_DELAY_MS, (void*)(uintptr_t)id);
+    if (timer) {
+        lv_timer_set_repeat_count(timer, 1);
+    }
+#endif
+}
+
+void gui_screen_load(gui_screen_id_t id) {
+    lv_obj_t *screen = gui_screen_get(id);
+    screens[id].last_shown = lv_tick_get();
+    lv_screen_load(screen);
+    
+    // Deferred, this may run in an event of a widget on the screen just left
+    if (CONFIG_LAUNCHER_SCREEN_RECLAIM_PCT < 100) {
+        lv_async_call(reclaim_cold_screens, NULL);
+    }
+    prefetch(screens[id].likely_next);
+}
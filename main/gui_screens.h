@@ -2,6 +2,8 @@
 #define GUI_SCREENS_H
 
 #include "lvgl.h"
+#include <stddef.h>
+#include <stdbool.h>
 
 // Screen objects (extern declarations)
 extern lv_obj_t *main_screen;
@@ -20,11 +22,36 @@ extern lv_obj_t *progress_bar;
 extern lv_obj_t *progress_label;
 extern lv_obj_t *progress_step_label;
 
+typedef enum {
+    GUI_SCREEN_MAIN = 0,
+    GUI_SCREEN_FILE_MANAGER,
+    GUI_SCREEN_FIRMWARE_LOADER,
+    GUI_SCREEN_PROGRESS,
+    GUI_SCREEN_SPLASH,
+    GUI_SCREEN_COUNT,
+} gui_screen_id_t;
+
 /**
- * @brief Create all screens
+ * @brief Initialize the styles, screens are built when first needed
  */
 void gui_screens_init(void);
 
+/**
+ * @brief Get a screen, building it if it does not exist yet
+ * @param id Screen
+ * @return Screen object
+ */
+lv_obj_t *gui_screen_get(gui_screen_id_t id);
+
+/**
+ * @brief Build a screen if needed and show it
+ * Afterwards, screens that are not shown are reclaimed, least recently shown
+ * first, while the LVGL heap is above CONFIG_LAUNCHER_SCREEN_RECLAIM_PCT, and
+ * the screen usually opened next is built in the background.
+ * @param id Screen
+ */
+void gui_screen_load(gui_screen_id_t id);
+
 /**
  * @brief Create main menu screen
  */
@@ -50,6 +77,41 @@ void create_progress_screen(void);
  */
 void create_splash_screen(void);
 
+/**
+ * @brief Boot the installed firmware unless the splash screen is left in time
+ * @param timeout_ms Time before booting
+ */
+void splash_start_boot_countdown(uint32_t timeout_ms);
+
+/**
+ * @brief Stop the countdown started by splash_start_boot_countdown()
+ */
+void splash_cancel_boot_countdown(void);
+
+/**
+ * @brief Delete the file manager screen, it is built again when next shown
+ * @return false while a directory is being read into it
+ */
+bool destroy_file_manager_screen(void);
+
+/**
+ * @brief Delete the firmware loader screen, it is built again when next shown
+ * @return true
+ */
+bool destroy_firmware_loader_screen(void);
+
+/**
+ * @brief Delete the progress screen, it is built again when next shown
+ * @return true
+ */
+bool destroy_progress_screen(void);
+
+/**
+ * @brief Delete the splash screen, it is built again when next shown
+ * @return true
+ */
+bool destroy_splash_screen(void);
+
 /**
  * @brief Create manual reboot dialog screen
  */
@@ -66,13 +128,16 @@ void update_file_list(void);
 void update_firmware_list(void);
 
 /**
- * @brief Update main screen display
+ * @brief Stop filling the firmware list, call when leaving the firmware loader
  */
-void update_main_screen(void);
+void cancel_firmware_list_update(void);
 
 /**
- * @brief Update main screen display
+ * @brief Offer to resume a flash that was interrupted by a reset or power loss
+ * @param firmware_path Firmware path (relative to SD root)
+ * @param committed Bytes already written and verified
+ * @param total Image size in bytes
  */
-void update_main_screen(void);
+void show_resume_flash_dialog(const char *firmware_path, size_t committed, size_t total);
 
 #endif // GUI_SCREENS_H
\ No newline at end of file
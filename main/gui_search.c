@@ -0,0 +1,43 @@
+#include "gui_search.h"
+#include "gui_styles.h"
+
+static void search_focus_event_handler(lv_event_t *e) {
+    lv_event_code_t code = lv_event_get_code(e);
+    lv_obj_t *keyboard = lv_event_get_user_data(e);
+    
+    if (code == LV_EVENT_FOCUSED) {
+        lv_keyboard_set_textarea(keyboard, lv_event_get_target(e));
+        lv_obj_remove_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
+    } else if (code == LV_EVENT_DEFOCUSED) {
+        lv_obj_add_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
+    }
+}
+
+static void keyboard_event_handler(lv_event_t *e) {
+    // The keyboard's OK and close keys end the search input
+    lv_obj_t *textarea = lv_event_get_user_data(e);
+    lv_obj_remove_state(textarea, LV_STATE_FOCUSED);
+    lv_obj_add_flag(lv_event_get_target(e), LV_OBJ_FLAG_HIDDEN);
+}
+
+lv_obj_t *gui_search_create(lv_obj_t *parent, lv_obj_t *screen, lv_event_cb_t changed_cb) {
+    lv_obj_t *textarea = lv_textarea_create(parent);
+    lv_textarea_set_one_line(textarea, true);
+    lv_textarea_set_placeholder_text(textarea, "Search");
+    lv_obj_set_style_bg_color(textarea, THEME_BG_COLOR, 0);
+    lv_obj_set_style_border_color(textarea, THEME_BORDER_COLOR, 0);
+    lv_obj_set_style_text_color(textarea, THEME_TEXT_COLOR, 0);
+    lv_obj_set_style_text_font(textarea, THEME_FONT_NORMAL, 0);
+    lv_obj_add_event_cb(textarea, changed_cb, LV_EVENT_VALUE_CHANGED, NULL);
+    
+    lv_obj_t *keyboard = lv_keyboard_create(screen);
+    lv_obj_set_size(keyboard, lv_pct(50), lv_pct(50));
+    lv_obj_align(keyboard, LV_ALIGN_BOTTOM_RIGHT, 0, 0);
+    lv_obj_add_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
+    lv_obj_add_event_cb(keyboard, keyboard_event_handler, LV_EVENT_READY, textarea);
+    lv_obj_add_event_cb(keyboard, keyboard_event_handler, LV_EVENT_CANCEL, textarea);
+    
+    lv_obj_add_event_cb(textarea, search_focus_event_handler, LV_EVENT_FOCUSED, keyboard);
+    lv_obj_add_event_cb(textarea, search_focus_event_handler, LV_EVENT_DEFOCUSED, keyboard);
+    return textarea;
+}
@@ -0,0 +1,17 @@
+#ifndef GUI_SEARCH_H
+#define GUI_SEARCH_H
+
+#include "lvgl.h"
+
+/**
+ * @brief Create a one-line search box with an on-screen keyboard
+ * The keyboard fills the bottom of the otherwise empty right half of the
+ * screen while the box has focus.
+ * @param parent Container of the box
+ * @param screen Screen the keyboard is shown on
+ * @param changed_cb Called on LV_EVENT_VALUE_CHANGED, on every keystroke
+ * @return Text area, read it with lv_textarea_get_text()
+ */
+lv_obj_t *gui_search_create(lv_obj_t *parent, lv_obj_t *screen, lv_event_cb_t changed_cb);
+
+#endif // GUI_SEARCH_H
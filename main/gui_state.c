@@ -1,20 +1,76 @@
 #include "gui_state.h"
+#include "firmware_slots.h"
+#include <stdio.h>
+#include <string.h>
+
+#define INSTALLED_FIRMWARE_LEN (MAX_FIRMWARE_NAME_LEN + FIRMWARE_SLOT_VERSION_LEN + 2)
 
 // State variables
 char current_directory[512] = "/";
-file_entry_t current_entries[32];
-int current_entry_count = 0;
-firmware_info_t firmware_files[16];
-int firmware_count = 0;
+sd_listing_t *current_listing = NULL;
+firmware_list_t *firmware_listing = NULL;
 int selected_firmware = -1;
 
 // Progress state
-volatile bool progress_update_pending = false;
-volatile size_t pending_bytes_written = 0;
-volatile size_t pending_total_bytes = 0;
-char pending_step_description[128] = {0};
 bool flashing_in_progress = false;
 
-// Boot screen state
-bool boot_screen_active = false;
-bool should_show_main = false;
\ No newline at end of file
+// Observable state
+lv_subject_t sd_mounted_subject;
+lv_subject_t firmware_ready_subject;
+lv_subject_t installed_firmware_subject;
+static char installed_firmware[INSTALLED_FIRMWARE_LEN];
+static char installed_firmware_prev[INSTALLED_FIRMWARE_LEN];
+static bool subjects_ready = false;
+
+static void set_int_if_changed(lv_subject_t *subject, int32_t value) {
+    if (lv_subject_get_int(subject) != value) {
+        lv_subject_set_int(subject, value);
+    }
+}
+
+esp_err_t gui_state_init(void) {
+    if (!current_listing) {
+        current_listing = sd_listing_create();
+    }
+    if (!firmware_listing) {
+        firmware_listing = firmware_list_create();
+    }
+    // The screens use both without checking
+    if (!current_listing || !firmware_listing) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    // Before any screen is created, widgets bind to them as they are built
+    if (!subjects_ready) {
+        lv_subject_init_int(&sd_mounted_subject, 0);
+        lv_subject_init_int(&firmware_ready_subject, 0);
+        lv_subject_init_string(&installed_firmware_subject, installed_firmware, installed_firmware_prev,
+                               sizeof(installed_firmware), "");
+        subjects_ready = true;
+    }
+    gui_state_refresh_sd();
+    gui_state_refresh_firmware();
+    return ESP_OK;
+}
+
+void gui_state_refresh_sd(void) {
+    set_int_if_changed(&sd_mounted_subject, sd_manager_is_mounted() ? 1 : 0);
+}
+
+void gui_state_refresh_firmware(void) {
+    char text[INSTALLED_FIRMWARE_LEN] = "";
+    int slot = firmware_slots_most_recent();
+    if (slot >= 0) {
+        const firmware_slot_t *info = firmware_slots_get(slot);
+        if (info->version[0] != '\0') {
+            snprintf(text, sizeof(text), "%s %s", info->name, info->version);
+        } else {
+            snprintf(text, sizeof(text), "%s", info->name);
+        }
+    }
+    
+    set_int_if_changed(&firmware_ready_subject, slot >= 0 ? 1 : 0);
+    if (strcmp(lv_subject_get_string(&installed_firmware_subject), text) != 0) {
+        lv_subject_copy_string(&installed_firmware_subject, text);
+    }
+}
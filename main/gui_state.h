@@ -3,25 +3,40 @@
 
 #include "sd_manager.h"
 #include "firmware_loader.h"
+#include "lvgl.h"
 #include <stdbool.h>
 
 // State variables
 extern char current_directory[512];
-extern file_entry_t current_entries[32];
-extern int current_entry_count;
-extern firmware_info_t firmware_files[16];
-extern int firmware_count;
+extern sd_listing_t *current_listing;      // Entries of current_directory
+extern firmware_list_t *firmware_listing;  // Firmware files on the card
 extern int selected_firmware;
 
 // Progress state
-extern volatile bool progress_update_pending;
-extern volatile size_t pending_bytes_written;
-extern volatile size_t pending_total_bytes;
-extern char pending_step_description[128];
 extern bool flashing_in_progress;
 
-// Boot screen state
-extern bool boot_screen_active;
-extern bool should_show_main;
+// Observable state, widgets bind to these and only they redraw on a change.
+// Set from the LVGL side only, observers update widgets directly.
+extern lv_subject_t sd_mounted_subject;         // int, 1 while a card is mounted
+extern lv_subject_t firmware_ready_subject;     // int, 1 while a slot holds a firmware
+extern lv_subject_t installed_firmware_subject; // string, name and version of the firmware Run boots
+
+/**
+ * @brief Allocate the listings the screens are filled from
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if a listing could not be allocated
+ */
+esp_err_t gui_state_init(void);
+
+/**
+ * @brief Update sd_mounted_subject from the SD manager
+ * Observers are only notified if the value changed.
+ */
+void gui_state_refresh_sd(void);
+
+/**
+ * @brief Update firmware_ready_subject and installed_firmware_subject from the slots
+ * Observers are only notified if the values changed.
+ */
+void gui_state_refresh_firmware(void);
 
 #endif // GUI_STATE_H
\ No newline at end of file
@@ -0,0 +1,224 @@
+#include "gui_vlist.h"
+#include "gui_styles.h"
+#include "esp_log.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "GUI_VLIST";
+
+#define UNBOUND             SIZE_MAX
+#define SPARE_ROWS          2           // Partly visible rows at the top and bottom edges
+
+typedef struct {
+    lv_obj_t *obj;
+    lv_obj_t *icon;
+    lv_obj_t *label;
+    size_t position;                    // UNBOUND while hidden or stale
+} vlist_row_t;
+
+typedef struct {
+    gui_vlist_bind_cb_t bind_cb;
+    lv_event_cb_t click_cb;
+    lv_obj_t *spacer;                   // Sized to every row, gives the list its scroll range
+    vlist_row_t *rows;                  // Row for position p is rows[p % row_count]
+    size_t row_count;
+    vlist_row_t message;
+    size_t count;
+    int32_t row_height;
+    int32_t row_pitch;                  // Height plus the gap to the next row
+    gui_vlist_row_t scratch;            // Filled by bind_cb, too big for the LVGL task stack
+} vlist_t;
+
+static void row_init(vlist_t *vlist, lv_obj_t *list, vlist_row_t *row) {
+    row->obj = lv_button_create(list);
+    apply_list_item_style(row->obj);
+    lv_obj_set_size(row->obj, lv_pct(100), vlist->row_height);
+    lv_obj_set_flex_flow(row->obj, LV_FLEX_FLOW_ROW);
+    lv_obj_set_flex_align(row->obj, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER);
+    lv_obj_set_style_pad_column(row->obj, 10, 0);
+    lv_obj_add_flag(row->obj, LV_OBJ_FLAG_HIDDEN);
+
+    row->icon = lv_label_create(row->obj);
+    lv_label_set_text(row->icon, "");
+    row->label = lv_label_create(row->obj);
+    lv_label_set_long_mode(row->label, LV_LABEL_LONG_DOT);
+    lv_obj_set_flex_grow(row->label, 1);
+    row->position = UNBOUND;
+}
+
+static void row_show(vlist_row_t *row, const gui_vlist_row_t *content) {
+    lv_label_set_text(row->icon, content->icon ? content->icon : "");
+    lv_label_set_text(row->label, content->text);
+    lv_obj_set_style_text_color(row->obj, content->color, 0);
+    lv_obj_set_user_data(row->obj, (void*)(uintptr_t)content->item);
+    lv_obj_remove_flag(row->obj, LV_OBJ_FLAG_HIDDEN);
+}
+
+static void row_hide(vlist_row_t *row) {
+    if (row->position != UNBOUND) {
+        lv_obj_add_flag(row->obj, LV_OBJ_FLAG_HIDDEN);
+        row->position = UNBOUND;
+    }
+}
+
+// Make sure there are enough rows to cover the viewport
+static void grow_pool(vlist_t *vlist, lv_obj_t *list) {
+    int32_t viewport = lv_obj_get_content_height(list);
+    size_t needed = (size_t)(viewport / vlist->row_pitch) + SPARE_ROWS;
+    if (needed <= vlist->row_count) {
+        return;
+    }
+
+    vlist_row_t *rows = realloc(vlist->rows, needed * sizeof(vlist_row_t));
+    if (!rows) {
+        ESP_LOGE(TAG, "Out of memory for %u rows", (unsigned)needed);
+        return;
+    }
+    vlist->rows = rows;
+    for (size_t i = vlist->row_count; i < needed; i++) {
+        row_init(vlist, list, &rows[i]);
+        lv_obj_add_event_cb(rows[i].obj, vlist->click_cb, LV_EVENT_CLICKED, NULL);
+    }
+    // The ring mapping changes with the pool size, every row is rebound
+    for (size_t i = 0; i < vlist->row_count; i++) {
+        row_hide(&rows[i]);
+    }
+    vlist->row_count = needed;
+}
+
+static void update_rows(lv_obj_t *list) {
+    vlist_t *vlist = lv_obj_get_user_data(list);
+    grow_pool(vlist, list);
+    if (vlist->row_count == 0) {
+        return;
+    }
+
+    int32_t scroll_y = lv_obj_get_scroll_y(list);
+    size_t first = scroll_y > 0 ? (size_t)(scroll_y / vlist->row_pitch) : 0;
+    for (size_t position = first; position < first + vlist->row_count; position++) {
+        vlist_row_t *row = &vlist->rows[position % vlist->row_count];
+        if (position >= vlist->count) {
+            row_hide(row);
+            continue;
+        }
+        if (row->position == position) {
+            continue;
+        }
+
+        // Only rows scrolling into view are rebound
+        vlist->scratch.icon = NULL;
+        vlist->scratch.color = THEME_TEXT_COLOR;
+        vlist->scratch.item = position;
+        vlist->scratch.text[0] = '\0';
+        vlist->bind_cb(position, &vlist->scratch);
+        lv_obj_set_y(row->obj, (int32_t)position * vlist->row_pitch);
+        row_show(row, &vlist->scratch);
+        row->position = position;
+    }
+}
+
+static void vlist_event_handler(lv_event_t *e) {
+    lv_obj_t *list = lv_event_get_current_target(e);
+    lv_event_code_t code = lv_event_get_code(e);
+
+    if (code == LV_EVENT_SCROLL || code == LV_EVENT_SIZE_CHANGED) {
+        update_rows(list);
+    } else if (code == LV_EVENT_DELETE) {
+        // The row objects are children of the list and go with it
+        vlist_t *vlist = lv_obj_get_user_data(list);
+        free(vlist->rows);
+        free(vlist);
+    }
+}
+
+lv_obj_t *gui_vlist_create(lv_obj_t *parent, gui_vlist_bind_cb_t bind_cb, lv_event_cb_t click_cb) {
+    vlist_t *vlist = calloc(1, sizeof(vlist_t));
+    if (!vlist) {
+        return NULL;
+    }
+    vlist->bind_cb = bind_cb;
+    vlist->click_cb = click_cb;
+
+    lv_obj_t *list = lv_obj_create(parent);
+    apply_list_style(list);
+    lv_obj_set_scroll_dir(list, LV_DIR_VER);
+    lv_obj_set_user_data(list, vlist);
+    lv_obj_add_event_cb(list, vlist_event_handler, LV_EVENT_SCROLL, NULL);
+    lv_obj_add_event_cb(list, vlist_event_handler, LV_EVENT_SIZE_CHANGED, NULL);
+    lv_obj_add_event_cb(list, vlist_event_handler, LV_EVENT_DELETE, NULL);
+
+    vlist->spacer = lv_obj_create(list);
+    lv_obj_remove_style_all(vlist->spacer);
+    lv_obj_remove_flag(vlist->spacer, LV_OBJ_FLAG_CLICKABLE);
+    lv_obj_set_size(vlist->spacer, 1, 0);
+
+    // One line of text, sized from the list item style so rows look like lv_list buttons
+    row_init(vlist, list, &vlist->message);
+    lv_obj_remove_flag(vlist->message.obj, LV_OBJ_FLAG_CLICKABLE);
+    lv_obj_t *obj = vlist->message.obj;
+    vlist->row_height = lv_font_get_line_height(lv_obj_get_style_text_font(obj, LV_PART_MAIN)) +
+                        lv_obj_get_style_pad_top(obj, LV_PART_MAIN) + lv_obj_get_style_pad_bottom(obj, LV_PART_MAIN) +
+                        2 * lv_obj_get_style_border_width(obj, LV_PART_MAIN);
+    vlist->row_pitch = vlist->row_height + lv_obj_get_style_margin_bottom(obj, LV_PART_MAIN);
+    lv_obj_set_height(obj, vlist->row_height);
+    return list;
+}
+
+// Set before anything scrolls, scroll events rebind rows against the count
+static void apply_count(vlist_t *vlist, size_t count) {
+    row_hide(&vlist->message);
+    vlist->count = count;
+    lv_obj_set_height(vlist->spacer, (int32_t)count * vlist->row_pitch);
+}
+
+void gui_vlist_set_count(lv_obj_t *list, size_t count) {
+    vlist_t *vlist = lv_obj_get_user_data(list);
+    apply_count(vlist, count);
+
+    // Rows past the new end are hidden by update_rows()
+    lv_obj_update_layout(list);
+    update_rows(list);
+}
+
+void gui_vlist_refresh(lv_obj_t *list, size_t count) {
+    vlist_t *vlist = lv_obj_get_user_data(list);
+    for (size_t i = 0; i < vlist->row_count; i++) {
+        row_hide(&vlist->rows[i]);
+    }
+    gui_vlist_set_count(list, count);
+}
+
+void gui_vlist_reset(lv_obj_t *list, size_t count) {
+    vlist_t *vlist = lv_obj_get_user_data(list);
+    for (size_t i = 0; i < vlist->row_count; i++) {
+        row_hide(&vlist->rows[i]);
+    }
+    apply_count(vlist, count);
+    lv_obj_scroll_to_y(list, 0, LV_ANIM_OFF);
+    lv_obj_update_layout(list);
+    update_rows(list);
+}
+
+size_t gui_vlist_get_count(lv_obj_t *list) {
+    vlist_t *vlist = lv_obj_get_user_data(list);
+    return vlist->count;
+}
+
+void gui_vlist_show_message(lv_obj_t *list, const char *icon, const char *text, lv_color_t color) {
+    vlist_t *vlist = lv_obj_get_user_data(list);
+    gui_vlist_reset(list, 0);
+
+    vlist->scratch.icon = icon;
+    vlist->scratch.color = color;
+    vlist->scratch.item = UNBOUND;
+    strncpy(vlist->scratch.text, text, sizeof(vlist->scratch.text) - 1);
+    vlist->scratch.text[sizeof(vlist->scratch.text) - 1] = '\0';
+    row_show(&vlist->message, &vlist->scratch);
+    vlist->message.position = 0;
+}
+
+size_t gui_vlist_get_item(lv_event_t *e) {
+    lv_obj_t *row = lv_event_get_current_target(e);
+    return (size_t)(uintptr_t)lv_obj_get_user_data(row);
+}
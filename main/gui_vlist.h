@@ -0,0 +1,83 @@
+#ifndef GUI_VLIST_H
+#define GUI_VLIST_H
+
+#include "lvgl.h"
+#include <stddef.h>
+
+#define GUI_VLIST_TEXT_LEN 256
+
+// What a row shows, filled in by the bind callback
+typedef struct {
+    const char *icon;               // LV_SYMBOL_*, may be NULL
+    lv_color_t color;               // Text and icon color
+    size_t item;                    // Handed to the click handler, see gui_vlist_get_item()
+    char text[GUI_VLIST_TEXT_LEN];
+} gui_vlist_row_t;
+
+/**
+ * @brief Fill in the row shown at a position of the list
+ * @param position Position in the list, below the count
+ * @param row Row to fill, color defaults to the list item text color
+ */
+typedef void (*gui_vlist_bind_cb_t)(size_t position, gui_vlist_row_t *row);
+
+/**
+ * @brief Create a scrolling list that only has objects for the rows on screen
+ * A pool of rows sized to the viewport is moved and rebound as the list
+ * scrolls, so a list of 10000 entries costs as much as one of 10.
+ * @param parent Parent object
+ * @param bind_cb Called whenever a row comes into view
+ * @param click_cb Called on LV_EVENT_CLICKED of a row
+ * @return List object, size and align it like any other
+ */
+lv_obj_t *gui_vlist_create(lv_obj_t *parent, gui_vlist_bind_cb_t bind_cb, lv_event_cb_t click_cb);
+
+/**
+ * @brief Show count rows from the top, rebinding every row
+ * Use when the entries changed, were sorted or filtered.
+ * @param list List
+ * @param count Number of rows
+ */
+void gui_vlist_reset(lv_obj_t *list, size_t count);
+
+/**
+ * @brief Change the number of rows, keeping the scroll position and bound rows
+ * Use when entries were appended and the existing ones did not move.
+ * @param list List
+ * @param count Number of rows
+ */
+void gui_vlist_set_count(lv_obj_t *list, size_t count);
+
+/**
+ * @brief Change the number of rows and rebind every row, keeping the scroll position
+ * Use when entries were added somewhere other than the end.
+ * @param list List
+ * @param count Number of rows
+ */
+void gui_vlist_refresh(lv_obj_t *list, size_t count);
+
+/**
+ * @brief Get the number of rows
+ * @param list List
+ * @return Number of rows, 0 while a message is shown
+ */
+size_t gui_vlist_get_count(lv_obj_t *list);
+
+/**
+ * @brief Replace the rows by a single line that cannot be clicked
+ * For "Loading..." and empty results. Cleared by the next gui_vlist_reset().
+ * @param list List
+ * @param icon LV_SYMBOL_*, may be NULL
+ * @param text Text, copied
+ * @param color Text and icon color
+ */
+void gui_vlist_show_message(lv_obj_t *list, const char *icon, const char *text, lv_color_t color);
+
+/**
+ * @brief Get the item bound to the row a click handler was called for
+ * @param e Event passed to the click handler
+ * @return row->item set by the bind callback
+ */
+size_t gui_vlist_get_item(lv_event_t *e);
+
+#endif // GUI_VLIST_H
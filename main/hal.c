@@ -1,39 +1,18 @@
 #include "hal.h"
 #include "bsp/m5stack_tab5.h"
 #include "esp_log.h"
-#include "esp_lcd_touch.h"
+#include "esp_timer.h"
 
 lv_display_t *lvDisp = NULL;
 lv_indev_t *lvTouchpad = NULL;
 
-extern esp_lcd_touch_handle_t _lcd_touch_handle;
+// The LVGL task sleeps until its next timer is due or it is woken up, these only bound that
+#define LVGL_MAX_SLEEP_MS       1000
+#define LVGL_TICK_PERIOD_MS     1000    // The port's tick timer, LVGL reads the time from lvgl_tick_cb()
 
-static void lvgl_read_cb(lv_indev_t *indev, lv_indev_data_t *data)
+static uint32_t lvgl_tick_cb(void)
 {
-    if (_lcd_touch_handle == NULL)
-    {
-        data->state = LV_INDEV_STATE_REL;
-        return;
-    }
-    uint16_t touch_x[1];
-    uint16_t touch_y[1];
-    uint16_t touch_strength[1];
-    uint8_t touch_cnt = 0;
-
-    esp_lcd_touch_read_data(_lcd_touch_handle);
-    bool touchpad_pressed =
-        esp_lcd_touch_get_coordinates(_lcd_touch_handle, touch_x, touch_y, touch_strength, &touch_cnt, 1);
-
-    if (!touchpad_pressed)
-    {
-        data->state = LV_INDEV_STATE_REL;
-    }
-    else
-    {
-        data->state = LV_INDEV_STATE_PR;
-        data->point.x = touch_x[0];
-        data->point.y = touch_y[0];
-    }
+    return (uint32_t)(esp_timer_get_time() / 1000);
 }
 
 void hal_init(void)
@@ -65,18 +44,24 @@ void hal_init(void)
         }
     };
     
+    cfg.lvgl_port_cfg.task_max_sleep_ms = LVGL_MAX_SLEEP_MS;
+    cfg.lvgl_port_cfg.timer_period_ms = LVGL_TICK_PERIOD_MS;
+    
     lvDisp = bsp_display_start_with_config(&cfg);
+    bsp_display_lock(0);
+    // Exact to the millisecond without a tick interrupt every few milliseconds
+    lv_tick_set_cb(lvgl_tick_cb);
     lv_display_set_rotation(lvDisp, LV_DISPLAY_ROTATION_90);
+    bsp_display_unlock();
     bsp_display_backlight_on();
 }
 
 void hal_touchpad_init(void)
 {
-    // Initialize touchpad input
-    lvTouchpad = lv_indev_create();
-    lv_indev_set_type(lvTouchpad, LV_INDEV_TYPE_POINTER);
-    lv_indev_set_read_cb(lvTouchpad, lvgl_read_cb);
-    lv_indev_set_display(lvTouchpad, lvDisp);
+    // The BSP already added the GT911 through esp_lvgl_port, which reads it when
+    // the touch interrupt fires. A second, polled input device would wake the
+    // LVGL task every refresh period and race it for the same touch reports.
+    lvTouchpad = bsp_display_get_input_dev();
 }
 
 // void hal_touchpad_deinit(void) not needed anymore
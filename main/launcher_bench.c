@@ -0,0 +1,449 @@
+#include "launcher_bench.h"
+#include "sd_manager.h"
+#include "firmware_source.h"
+#include "firmware_image.h"
+#include "flash_engine.h"
+#include "flash_erase.h"
+#include "firmware_digest.h"
+#include "firmware_slots.h"
+#include "esp_log.h"
+#include "esp_app_desc.h"
+#include "esp_partition.h"
+#include "esp_ota_ops.h"
+#include "esp_image_format.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+static const char *TAG = "BENCH";
+
+#define BENCH_DIR        "/.bench"
+#define BENCH_APP_IMAGE  BENCH_DIR "/launcher.bin"
+
+static const size_t bench_image_sizes[] = { 256 * 1024, 1024 * 1024, 4 * 1024 * 1024 };
+static const size_t bench_chunk_sizes[] = { 16 * 1024, 32 * 1024, 64 * 1024, 128 * 1024 };
+static const int bench_dir_sizes[] = { 100, 1000, 10000 };
+
+#define BENCH_COUNT(a)   (sizeof(a) / sizeof((a)[0]))
+#define BENCH_MAX_CHUNK  (128 * 1024)
+
+static float mb_per_s(size_t bytes, int64_t us) {
+    return (us > 0) ? ((float)bytes / (1024.0f * 1024.0f)) / ((float)us / 1000000.0f) : 0.0f;
+}
+
+static void emit(const char *stage, size_t image_size, size_t chunk_size, int64_t us) {
+    printf("BENCH {\"stage\":\"%s\",\"image\":%zu,\"chunk\":%zu,\"us\":%" PRId64 ",\"mbps\":%.2f}\n",
+           stage, image_size, chunk_size, us, mb_per_s(image_size, us));
+}
+
+static void emit_listing(const char *stage, int entry_count, int found, int64_t us) {
+    printf("BENCH {\"stage\":\"%s\",\"entries\":%d,\"found\":%d,\"us\":%" PRId64 ",\"entries_per_s\":%.1f}\n",
+           stage, entry_count, found, us, (us > 0) ? (double)found * 1000000.0 / (double)us : 0.0);
+}
+
+// Deterministic filler so every run programs and reads the same bytes
+static void fill_pattern(uint8_t *buf, size_t len, uint32_t seed) {
+    uint32_t x = seed | 1;
+    for (size_t i = 0; i + 4 <= len; i += 4) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        memcpy(buf + i, &x, 4);
+    }
+}
+
+static esp_err_t prepare_image(const char *path, size_t image_size, uint8_t *buf) {
+    if (sd_manager_get_file_size(path) == image_size) {
+        return ESP_OK;
+    }
+
+    ESP_LOGI(TAG, "Creating %s (%zu bytes)", path, image_size);
+    FILE *file = sd_manager_open_file(path, "wb");
+    if (!file) {
+        return ESP_FAIL;
+    }
+
+    esp_err_t ret = ESP_OK;
+    for (size_t offset = 0; offset < image_size; offset += BENCH_MAX_CHUNK) {
+        size_t len = (image_size - offset < BENCH_MAX_CHUNK) ? image_size - offset : BENCH_MAX_CHUNK;
+        fill_pattern(buf, len, offset);
+        if (fwrite(buf, 1, len, file) != len) {
+            ESP_LOGE(TAG, "Write failed at offset %zu", offset);
+            ret = ESP_FAIL;
+            break;
+        }
+    }
+    sd_manager_close_file(file);
+    return ret;
+}
+
+static esp_err_t bench_read(const char *path, size_t image_size, size_t chunk_size, uint8_t *buf) {
+    firmware_source_t *src = NULL;
+    esp_err_t ret = firmware_source_open(path, &src);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    for (size_t offset = 0; offset < image_size && ret == ESP_OK; ) {
+        size_t got = 0;
+        ret = firmware_source_read(src, buf, chunk_size, &got);
+        if (ret == ESP_OK && got == 0) {
+            ret = ESP_ERR_INVALID_SIZE;
+        }
+        offset += got;
+    }
+    int64_t us = esp_timer_get_time() - t0;
+    firmware_source_close(src);
+
+    if (ret == ESP_OK) {
+        emit("read", image_size, chunk_size, us);
+    }
+    return ret;
+}
+
+// A/B against the raw path: newlib buffering plus a copy out of the FILE buffer
+static esp_err_t bench_read_stdio(const char *path, size_t image_size, size_t chunk_size, uint8_t *buf) {
+    FILE *file = sd_manager_open_file(path, "rb");
+    if (!file) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_err_t ret = ESP_OK;
+    int64_t t0 = esp_timer_get_time();
+    for (size_t offset = 0; offset < image_size; ) {
+        size_t got = fread(buf, 1, chunk_size, file);
+        if (got == 0) {
+            ret = ESP_ERR_INVALID_SIZE;
+            break;
+        }
+        offset += got;
+    }
+    int64_t us = esp_timer_get_time() - t0;
+    sd_manager_close_file(file);
+
+    if (ret == ESP_OK) {
+        emit("read_stdio", image_size, chunk_size, us);
+    }
+    return ret;
+}
+
+static esp_err_t bench_read_raw(const char *path, size_t image_size, size_t chunk_size, uint8_t *buf) {
+    sd_raw_file_t *file;
+    esp_err_t ret = sd_manager_raw_open(path, &file);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    for (size_t offset = 0; offset < image_size && ret == ESP_OK; ) {
+        size_t got = 0;
+        ret = sd_manager_raw_read(file, buf, chunk_size, &got);
+        if (ret == ESP_OK && got == 0) {
+            ret = ESP_ERR_INVALID_SIZE;
+        }
+        offset += got;
+    }
+    int64_t us = esp_timer_get_time() - t0;
+    sd_manager_raw_close(file);
+
+    if (ret == ESP_OK) {
+        emit("read_raw", image_size, chunk_size, us);
+    }
+    return ret;
+}
+
+static esp_err_t bench_flash(const esp_partition_t *part, size_t image_size, size_t chunk_size, const uint8_t *buf) {
+    flash_erase_sched_t erase;
+    esp_err_t ret = ESP_OK;
+
+    // Erase separately so program time is not mixed with erase time
+    flash_erase_sched_init(&erase, part, 0, image_size, 0);
+    for (size_t offset = 0; offset < image_size && ret == ESP_OK; offset += chunk_size) {
+        size_t len = (image_size - offset < chunk_size) ? image_size - offset : chunk_size;
+        ret = flash_erase_sched_ensure(&erase, offset + len);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    emit("erase", image_size, chunk_size, erase.erase_us);
+
+    int64_t t0 = esp_timer_get_time();
+    for (size_t offset = 0; offset < image_size && ret == ESP_OK; offset += chunk_size) {
+        size_t len = (image_size - offset < chunk_size) ? image_size - offset : chunk_size;
+        ret = esp_partition_write(part, offset, buf, len);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    emit("program", image_size, chunk_size, esp_timer_get_time() - t0);
+
+    // Same mapped readback the engine does after each chunk
+    t0 = esp_timer_get_time();
+    for (size_t offset = 0; offset < image_size && ret == ESP_OK; offset += chunk_size) {
+        size_t len = (image_size - offset < chunk_size) ? image_size - offset : chunk_size;
+        const void *mapped = NULL;
+        esp_partition_mmap_handle_t map_handle;
+        ret = esp_partition_mmap(part, offset, len, ESP_PARTITION_MMAP_DATA, &mapped, &map_handle);
+        if (ret != ESP_OK) {
+            break;
+        }
+        if (memcmp(mapped, buf, len) != 0) {
+            ESP_LOGE(TAG, "Readback mismatch in chunk at 0x%zx", offset);
+            ret = ESP_ERR_INVALID_CRC;
+        }
+        esp_partition_munmap(map_handle);
+    }
+    if (ret == ESP_OK) {
+        emit("verify", image_size, chunk_size, esp_timer_get_time() - t0);
+    }
+    return ret;
+}
+
+// A copy of the running launcher, a real app image so the engine runs every stage
+// including the hash and layout checks the synthetic images would fail
+static esp_err_t prepare_app_image(const char *path, size_t *image_size, uint8_t *buf) {
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    esp_partition_pos_t pos = {
+        .offset = running->address,
+        .size = running->size,
+    };
+    esp_image_metadata_t metadata;
+    esp_err_t ret = esp_image_get_metadata(&pos, &metadata);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    *image_size = metadata.image_len;
+
+    // Always rewritten, a file from an older launcher may have the same size
+    FILE *file = sd_manager_open_file(path, "wb");
+    if (!file) {
+        return ESP_FAIL;
+    }
+    for (size_t offset = 0; offset < *image_size && ret == ESP_OK; offset += BENCH_MAX_CHUNK) {
+        size_t len = (*image_size - offset < BENCH_MAX_CHUNK) ? *image_size - offset : BENCH_MAX_CHUNK;
+        ret = esp_partition_read(running, offset, buf, len);
+        if (ret == ESP_OK && fwrite(buf, 1, len, file) != len) {
+            ESP_LOGE(TAG, "Write failed at offset %zu", offset);
+            ret = ESP_FAIL;
+        }
+    }
+    sd_manager_close_file(file);
+    return ret;
+}
+
+// The whole pipeline as a flash runs it: reader task, ring, erase, program, readback and hash
+static esp_err_t bench_engine(const esp_partition_t *part, uint8_t *buf) {
+    size_t image_size = 0;
+    esp_err_t ret = prepare_app_image(BENCH_APP_IMAGE, &image_size, buf);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to copy the launcher image: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    if (image_size > part->size) {
+        ESP_LOGW(TAG, "Skipping engine run, launcher image does not fit %s", part->label);
+        return ESP_OK;
+    }
+
+    firmware_source_t *src = NULL;
+    ret = firmware_source_open(BENCH_APP_IMAGE, &src);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    firmware_image_info_t image;
+    ret = firmware_image_parse(src, &image);
+    if (ret != ESP_OK) {
+        firmware_source_close(src);
+        return ret;
+    }
+    flash_engine_job_t job = {
+        .source = src,
+        .image_size = image_size,
+        .hash_offset = image.hash_offset,
+        .partition = part,
+    };
+    flash_engine_stats_t stats;
+    ret = flash_engine_run(&job, &stats);
+    firmware_source_close(src);
+
+    if (ret == ESP_OK) {
+        emit("engine", image_size, FLASH_ENGINE_DEFAULT_CHUNK_SIZE, stats.total_us);
+        flash_engine_log_stats(&stats);
+    }
+    return ret;
+}
+
+// Listing as the launcher did it before going to FatFs directly, kept to compare against
+static int list_with_stat(const char *path) {
+    char full_path[128];
+    snprintf(full_path, sizeof(full_path), "%s%s", SD_MOUNT_POINT, path);
+
+    if (sd_manager_fs_acquire() != ESP_OK) {
+        return -1;
+    }
+    DIR *dir = opendir(full_path);
+    if (!dir) {
+        sd_manager_fs_release();
+        return -1;
+    }
+
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        char item_path[384];
+        snprintf(item_path, sizeof(item_path), "%s/%s", full_path, entry->d_name);
+        struct stat file_stat;
+        if (stat(item_path, &file_stat) == 0) {
+            count++;
+        }
+    }
+    closedir(dir);
+    sd_manager_fs_release();
+    return count;
+}
+
+static esp_err_t prepare_directory(const char *path, int entry_count, sd_listing_t *listing) {
+    if (sd_manager_scan_directory(path, listing) == entry_count) {
+        return ESP_OK;
+    }
+
+    ESP_LOGI(TAG, "Creating %s with %d files, this only happens once", path, entry_count);
+    char dir_path[64];
+    snprintf(dir_path, sizeof(dir_path), "%s%s", SD_MOUNT_POINT, path);
+    if (sd_manager_fs_acquire() != ESP_OK) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    mkdir(dir_path, 0775);
+    sd_manager_fs_release();
+
+    for (int i = 0; i < entry_count; i++) {
+        char file_path[96];
+        snprintf(file_path, sizeof(file_path), "%s/entry_%05d.bin", path, i);
+        FILE *file = sd_manager_open_file(file_path, "wb");
+        if (!file) {
+            ESP_LOGE(TAG, "Failed to create %s", file_path);
+            return ESP_FAIL;
+        }
+        sd_manager_close_file(file);
+        if ((i + 1) % 1000 == 0) {
+            ESP_LOGI(TAG, "%d / %d files", i + 1, entry_count);
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t bench_directory_listing(void) {
+    sd_listing_t *listing = sd_listing_create();
+    if (!listing) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = ESP_OK;
+    for (size_t i = 0; i < BENCH_COUNT(bench_dir_sizes) && ret == ESP_OK; i++) {
+        int entry_count = bench_dir_sizes[i];
+        char path[32];
+        snprintf(path, sizeof(path), BENCH_DIR "/dir_%d", entry_count);
+        ret = prepare_directory(path, entry_count, listing);
+        if (ret != ESP_OK) {
+            break;
+        }
+
+        // Refill a warm listing, as the file manager does when navigating
+        sd_manager_scan_directory(path, listing);
+        int64_t t0 = esp_timer_get_time();
+        int found = sd_manager_scan_directory(path, listing);
+        emit_listing("list_fatfs", entry_count, found, esp_timer_get_time() - t0);
+
+        // Quadratic on FAT, expect minutes for the largest directory
+        t0 = esp_timer_get_time();
+        found = list_with_stat(path);
+        emit_listing("list_stat", entry_count, found, esp_timer_get_time() - t0);
+    }
+
+    sd_listing_destroy(listing);
+    return ret;
+}
+
+static esp_err_t bench_flash_pipeline(void) {
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
+    if (!part) {
+        ESP_LOGE(TAG, "No ota_0 partition to benchmark against");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint8_t *buf = sd_manager_raw_alloc(BENCH_MAX_CHUNK);
+    if (!buf) {
+        buf = heap_caps_malloc(BENCH_MAX_CHUNK, MALLOC_CAP_DEFAULT);
+    }
+    if (!buf) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGW(TAG, "Benchmark overwrites partition %s", part->label);
+
+    // The slot record would otherwise keep pointing at an image that is about to go
+    esp_err_t ret = ESP_OK;
+    int slot = firmware_slots_index_of(part);
+    if (slot >= 0) {
+        ret = firmware_slots_release(slot);
+    }
+    firmware_digest_invalidate_partition(part);
+    for (size_t i = 0; i < BENCH_COUNT(bench_image_sizes) && ret == ESP_OK; i++) {
+        size_t image_size = bench_image_sizes[i];
+        if (image_size > part->size) {
+            ESP_LOGW(TAG, "Skipping %zu byte image, partition is only %" PRIu32 " bytes", image_size, part->size);
+            continue;
+        }
+
+        char path[64];
+        snprintf(path, sizeof(path), BENCH_DIR "/bench_%zuk.bin", image_size / 1024);
+        ret = prepare_image(path, image_size, buf);
+
+        for (size_t j = 0; j < BENCH_COUNT(bench_chunk_sizes) && ret == ESP_OK; j++) {
+            size_t chunk_size = bench_chunk_sizes[j];
+            ret = bench_read_stdio(path, image_size, chunk_size, buf);
+            if (ret == ESP_OK) {
+                ret = bench_read_raw(path, image_size, chunk_size, buf);
+            }
+            if (ret == ESP_OK) {
+                ret = bench_read(path, image_size, chunk_size, buf);
+            }
+            if (ret == ESP_OK) {
+                fill_pattern(buf, chunk_size, chunk_size);
+                ret = bench_flash(part, image_size, chunk_size, buf);
+            }
+        }
+    }
+
+    if (ret == ESP_OK) {
+        ret = bench_engine(part, buf);
+    }
+
+    firmware_digest_invalidate_partition(part);
+    heap_caps_free(buf);
+    return ret;
+}
+
+esp_err_t launcher_bench_run(void) {
+    if (!sd_manager_is_mounted()) {
+        ESP_LOGE(TAG, "SD card not mounted, skipping benchmark");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    mkdir(SD_MOUNT_POINT BENCH_DIR, 0775);
+
+    const esp_app_desc_t *app = esp_app_get_description();
+    printf("BENCH {\"event\":\"start\",\"version\":\"%s\",\"idf\":\"%s\"}\n", app->version, app->idf_ver);
+
+    esp_err_t ret = bench_flash_pipeline();
+    if (ret == ESP_OK) {
+        ret = bench_directory_listing();
+    }
+
+    printf("BENCH {\"event\":\"end\",\"result\":\"%s\"}\n", esp_err_to_name(ret));
+    return ret;
+}
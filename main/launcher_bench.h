@@ -0,0 +1,27 @@
+#ifndef LAUNCHER_BENCH_H
+#define LAUNCHER_BENCH_H
+
+#include "esp_err.h"
+
+/**
+ * @brief Measure flash pipeline throughput and print the results
+ *
+ * Reads, erases, programs and verifies synthetic images of several sizes
+ * with several chunk sizes. It reads with the same primitives the flash engine
+ * uses, and reports MB/s for each stage separately. A copy of the launcher's
+ * own image is then flashed once through the flash engine, for the end-to-end
+ * figure the stages add up to. Directory listing is timed
+ * on directories of 100, 1,000 and 10,000 files, once through FatFs and once
+ * with the per-entry stat() it replaced. Each result is printed to
+ * stdout as one JSON object per line, prefixed with "BENCH ", so runs can be
+ * collected from the serial log and compared between releases.
+ *
+ * Synthetic images and directories are created under /.bench on the SD card
+ * and reused when present; creating the largest directory takes a while.
+ * The ota_0 partition is overwritten, so any installed firmware is lost.
+ *
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t launcher_bench_run(void);
+
+#endif // LAUNCHER_BENCH_H
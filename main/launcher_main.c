@@ -1,19 +1,23 @@
 #include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "esp_ota_ops.h"
 #include "esp_partition.h"
 #include "hal.h"
+#include "esp_lvgl_port.h"
 #include "sd_manager.h"
 #include "gui_manager.h"
-#include "gui_state.h"
 #include "firmware_loader.h"
 #include "gui_screens.h"
+#include "flash_journal.h"
+#if CONFIG_LAUNCHER_BENCHMARK
+#include "launcher_bench.h"
+#endif
 
 static const char *TAG = "LAUNCHER";
-static uint32_t boot_timer_start = 0;
 static const uint32_t BOOT_SCREEN_TIMEOUT_MS = 5000; // 5 seconds
 
 void app_main(void) {
@@ -38,7 +42,8 @@ void app_main(void) {
         
         // If we're running from OTA partition, it means we just booted firmware
         // The rollback mechanism should handle returning to factory on next boot
-        if (running_partition->subtype == ESP_PARTITION_SUBTYPE_APP_OTA_0) {
+        if (running_partition->subtype >= ESP_PARTITION_SUBTYPE_APP_OTA_MIN &&
+            running_partition->subtype < ESP_PARTITION_SUBTYPE_APP_OTA_MAX) {
             ESP_LOGI(TAG, "Running from firmware partition - this is a one-time boot");
             ESP_LOGI(TAG, "System will return to launcher on next restart");
         }
@@ -49,13 +54,7 @@ void app_main(void) {
     hal_init();
     hal_touchpad_init();
     
-    // Initialize SD card
-    ESP_LOGI(TAG, "Initializing SD card...");
-    if (sd_manager_init() != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to initialize SD card");
-    }
-    
-    // Initialize firmware loader and boot manager
+    // Initialize firmware loader and boot manager, this brings up NVS
     ESP_LOGI(TAG, "Initializing firmware loader...");
     firmware_loader_init();
     
@@ -65,48 +64,55 @@ void app_main(void) {
         ESP_LOGE(TAG, "Failed to initialize boot manager: %s", esp_err_to_name(ret));
     }
     
-    // Initialize GUI
-    ESP_LOGI(TAG, "Initializing GUI...");
-    gui_manager_init((lv_display_t*)lvDisp);
+    // Initialize SD card, its bus clock is remembered in NVS
+    ESP_LOGI(TAG, "Initializing SD card...");
+    if (sd_manager_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize SD card");
+    }
+
+#if CONFIG_LAUNCHER_BENCHMARK
+    ESP_LOGI(TAG, "Running flash pipeline benchmark...");
+    launcher_bench_run();
+#endif
     
-    ESP_LOGI(TAG, "Launcher initialized successfully");
+    // An interrupted flash takes priority over auto-booting whatever is installed.
+    // Checked before taking the display lock, the SD task may take a moment.
+    flash_journal_t journal;
+    bool resume_flash = flash_journal_load(&journal) == ESP_OK && sd_manager_file_exists(journal.path);
     
-    // Unlock display
-    bsp_display_unlock();
+    // From here on LVGL belongs to the esp_lvgl_port task, app_main only sets it up under the lock
+    bsp_display_lock(0);
+    
+    // Initialize GUI
+    ESP_LOGI(TAG, "Initializing GUI...");
+    if (gui_manager_init((lv_display_t*)lvDisp) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize GUI");
+        bsp_display_unlock();
+        return;
+    }
     
     // Check if firmware is available and show appropriate screen
-    if (firmware_loader_is_firmware_ready()) {
+    if (resume_flash) {
+        ESP_LOGI(TAG, "Interrupted flash of %s found at %" PRIu32 " / %" PRIu32 " bytes",
+                 journal.path, journal.committed, journal.image_size);
+        gui_screen_load(GUI_SCREEN_MAIN);
+        show_resume_flash_dialog(journal.path, journal.committed, journal.image_size);
+    } else if (firmware_loader_is_firmware_ready()) {
         ESP_LOGI(TAG, "Firmware detected, showing boot screen for %d seconds", (int)(BOOT_SCREEN_TIMEOUT_MS / 1000));
-        boot_screen_active = true;
-        boot_timer_start = xTaskGetTickCount() * portTICK_PERIOD_MS;
         
         // Show splash screen with boot option
-        lv_screen_load(splash_screen);
+        gui_screen_load(GUI_SCREEN_SPLASH);
+        splash_start_boot_countdown(BOOT_SCREEN_TIMEOUT_MS);
     } else {
         ESP_LOGI(TAG, "No firmware detected, going directly to launcher");
-        lv_screen_load(main_screen);
+        gui_screen_load(GUI_SCREEN_MAIN);
     }
     
-    // Main loop
-    while (1) {
-        // Handle boot screen timeout
-        if (boot_screen_active) {
-            uint32_t current_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
-            if (current_time - boot_timer_start >= BOOT_SCREEN_TIMEOUT_MS) {
-                ESP_LOGI(TAG, "Boot screen timeout, auto-booting firmware");
-                boot_screen_active = false;
-                firmware_loader_boot_firmware_once();
-            }
-        }
-        
-        // Handle return to main screen after flash completion
-        if (should_show_main) {
-            should_show_main = false;
-            update_main_screen(); // Refresh the main screen to show updated firmware status
-            lv_screen_load(main_screen);
-        }
-        
-        gui_manager_update();
-        vTaskDelay(pdMS_TO_TICKS(10));
-    }
-}
\ No newline at end of file
+    bsp_display_unlock();
+    
+    // The LVGL task may be asleep until its next deadline, let it draw the first screen now
+    lvgl_port_task_wake(LVGL_PORT_EVENT_USER, NULL);
+    
+    // Nothing left to poll: workers post to the LVGL task through gui_manager_post()
+    ESP_LOGI(TAG, "Launcher initialized successfully");
+}
@@ -0,0 +1,307 @@
+#include "list_index.h"
+#include "psram_arena.h"
+#include "firmware_source.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+#include <stdint.h>
+
+#define NAME_ARENA_CHUNK    (16 * 1024)
+#define INITIAL_CAPACITY    64
+#define MAX_QUERY_LEN       64
+
+typedef struct {
+    const char *folded;     // Lower-cased name
+    time_t mtime;
+    uint32_t size;
+    bool is_directory;
+} index_key_t;
+
+struct list_index {
+    index_key_t *keys;
+    uint32_t *order;        // Every entry, sorted
+    uint32_t *matches;      // Entries passing filter and query, in sort order
+    uint32_t *view;         // matches with substring hits moved first
+    uint32_t *scratch;      // Merge sort buffer
+    size_t count;
+    size_t capacity;
+    size_t match_count;
+    psram_arena_t names;
+
+    list_sort_t sort;
+    bool descending;
+    list_filter_t filter;
+    char query[MAX_QUERY_LEN];
+    char matched_query[MAX_QUERY_LEN];  // Query matches was built for
+
+    bool order_dirty;       // Entries or sort changed
+    bool matches_dirty;     // Filter changed, or a query that cannot narrow
+    bool view_dirty;        // Query changed
+};
+
+static void *psram_realloc(void *ptr, size_t size) {
+    return heap_caps_realloc(ptr, size, MALLOC_CAP_SPIRAM);
+}
+
+list_index_t *list_index_create(void) {
+    list_index_t *index = heap_caps_calloc(1, sizeof(*index), MALLOC_CAP_SPIRAM);
+    if (!index) {
+        index = heap_caps_calloc(1, sizeof(*index), MALLOC_CAP_DEFAULT);
+    }
+    if (index) {
+        psram_arena_init(&index->names, NAME_ARENA_CHUNK);
+    }
+    return index;
+}
+
+void list_index_destroy(list_index_t *index) {
+    if (!index) {
+        return;
+    }
+    psram_arena_destroy(&index->names);
+    heap_caps_free(index->keys);
+    heap_caps_free(index->order);
+    heap_caps_free(index->matches);
+    heap_caps_free(index->view);
+    heap_caps_free(index->scratch);
+    heap_caps_free(index);
+}
+
+void list_index_clear(list_index_t *index) {
+    index->count = 0;
+    index->match_count = 0;
+    psram_arena_reset(&index->names);
+    index->order_dirty = true;
+}
+
+static bool grow(list_index_t *index) {
+    size_t capacity = index->capacity ? index->capacity * 2 : INITIAL_CAPACITY;
+    index_key_t *keys = psram_realloc(index->keys, capacity * sizeof(index_key_t));
+    if (!keys) {
+        return false;
+    }
+    index->keys = keys;
+
+    // All index arrays grow together, a failure leaves the old capacity usable
+    uint32_t **arrays[] = { &index->order, &index->matches, &index->view, &index->scratch };
+    for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+        uint32_t *grown = psram_realloc(*arrays[i], capacity * sizeof(uint32_t));
+        if (!grown) {
+            return false;
+        }
+        *arrays[i] = grown;
+    }
+    index->capacity = capacity;
+    return true;
+}
+
+esp_err_t list_index_add(list_index_t *index, const char *name, bool is_directory, size_t size, time_t mtime) {
+    if (index->count == index->capacity && !grow(index)) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    size_t len = strlen(name);
+    char *folded = psram_arena_alloc(&index->names, len + 1);
+    if (!folded) {
+        return ESP_ERR_NO_MEM;
+    }
+    // ASCII only, other UTF-8 bytes are compared as they are
+    for (size_t i = 0; i <= len; i++) {
+        char c = name[i];
+        folded[i] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+    }
+
+    index->keys[index->count++] = (index_key_t) {
+        .folded = folded,
+        .mtime = mtime,
+        .size = size,
+        .is_directory = is_directory,
+    };
+    index->order_dirty = true;
+    return ESP_OK;
+}
+
+void list_index_set_sort(list_index_t *index, list_sort_t sort, bool descending) {
+    if (sort != index->sort || descending != index->descending) {
+        index->sort = sort;
+        index->descending = descending;
+        index->order_dirty = true;
+    }
+}
+
+void list_index_set_filter(list_index_t *index, list_filter_t filter) {
+    if (filter != index->filter) {
+        index->filter = filter;
+        index->matches_dirty = true;
+    }
+}
+
+void list_index_set_query(list_index_t *index, const char *query) {
+    char folded[MAX_QUERY_LEN];
+    size_t len = 0;
+    for (; query && query[len] != '\0' && len < sizeof(folded) - 1; len++) {
+        char c = query[len];
+        folded[len] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+    }
+    folded[len] = '\0';
+
+    if (strcmp(folded, index->query) == 0) {
+        return;
+    }
+    // Every name matching the longer query also matches the shorter one
+    if (strncmp(folded, index->matched_query, strlen(index->matched_query)) != 0) {
+        index->matches_dirty = true;
+    }
+    strcpy(index->query, folded);
+    index->view_dirty = true;
+}
+
+bool list_index_is_identity(const list_index_t *index) {
+    return index->sort == LIST_SORT_NONE && index->filter == LIST_FILTER_ALL && index->query[0] == '\0';
+}
+
+static int compare_keys(const list_index_t *index, uint32_t a, uint32_t b) {
+    const index_key_t *ka = &index->keys[a];
+    const index_key_t *kb = &index->keys[b];
+    if (ka->is_directory != kb->is_directory) {
+        return ka->is_directory ? -1 : 1;
+    }
+
+    int result = 0;
+    switch (index->sort) {
+        case LIST_SORT_NAME:
+            result = strcmp(ka->folded, kb->folded);
+            break;
+        case LIST_SORT_SIZE:
+            result = (ka->size > kb->size) - (ka->size < kb->size);
+            break;
+        case LIST_SORT_DATE:
+            result = (ka->mtime > kb->mtime) - (ka->mtime < kb->mtime);
+            break;
+        default:
+            break;
+    }
+    return index->descending ? -result : result;
+}
+
+// Bottom-up merge sort, stable where qsort() is not
+static void sort_order(list_index_t *index) {
+    uint32_t *src = index->order;
+    uint32_t *dst = index->scratch;
+    size_t n = index->count;
+    for (size_t width = 1; width < n; width *= 2) {
+        for (size_t lo = 0; lo < n; lo += 2 * width) {
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            size_t i = lo, j = mid, k = lo;
+            while (i < mid && j < hi) {
+                dst[k++] = compare_keys(index, src[j], src[i]) < 0 ? src[j++] : src[i++];
+            }
+            while (i < mid) {
+                dst[k++] = src[i++];
+            }
+            while (j < hi) {
+                dst[k++] = src[j++];
+            }
+        }
+        uint32_t *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    if (src != index->order) {
+        memcpy(index->order, src, n * sizeof(uint32_t));
+    }
+}
+
+static bool passes_filter(const list_index_t *index, const index_key_t *key) {
+    switch (index->filter) {
+        case LIST_FILTER_DIRECTORIES:
+            return key->is_directory;
+        case LIST_FILTER_FILES:
+            return !key->is_directory;
+        case LIST_FILTER_IMAGES:
+            return key->is_directory || firmware_source_is_image_file(key->folded);
+        default:
+            return true;
+    }
+}
+
+static bool is_subsequence(const char *query, const char *name) {
+    for (; *query != '\0'; query++) {
+        name = strchr(name, *query);
+        if (!name) {
+            return false;
+        }
+        name++;
+    }
+    return true;
+}
+
+static void update_matches(list_index_t *index) {
+    size_t kept = 0;
+    if (index->matches_dirty) {
+        // Start over from every entry
+        for (size_t i = 0; i < index->count; i++) {
+            uint32_t entry = index->order[i];
+            const index_key_t *key = &index->keys[entry];
+            if (passes_filter(index, key) && is_subsequence(index->query, key->folded)) {
+                index->matches[kept++] = entry;
+            }
+        }
+    } else {
+        // Narrow down the previous matches
+        for (size_t i = 0; i < index->match_count; i++) {
+            uint32_t entry = index->matches[i];
+            if (is_subsequence(index->query, index->keys[entry].folded)) {
+                index->matches[kept++] = entry;
+            }
+        }
+    }
+    index->match_count = kept;
+    strcpy(index->matched_query, index->query);
+    index->matches_dirty = false;
+}
+
+static void update_view(list_index_t *index) {
+    if (index->query[0] == '\0') {
+        memcpy(index->view, index->matches, index->match_count * sizeof(uint32_t));
+        return;
+    }
+    // Stable partition: substring hits first, then the looser subsequence hits
+    size_t front = 0;
+    size_t back = 0;
+    for (size_t i = 0; i < index->match_count; i++) {
+        uint32_t entry = index->matches[i];
+        if (strstr(index->keys[entry].folded, index->query)) {
+            index->view[front++] = entry;
+        } else {
+            index->scratch[back++] = entry;
+        }
+    }
+    memcpy(index->view + front, index->scratch, back * sizeof(uint32_t));
+}
+
+size_t list_index_count(list_index_t *index) {
+    if (index->order_dirty) {
+        for (size_t i = 0; i < index->count; i++) {
+            index->order[i] = i;
+        }
+        if (index->sort != LIST_SORT_NONE) {
+            sort_order(index);
+        }
+        index->order_dirty = false;
+        index->matches_dirty = true;
+    }
+    if (index->matches_dirty || strcmp(index->query, index->matched_query) != 0) {
+        update_matches(index);
+        index->view_dirty = true;
+    }
+    if (index->view_dirty) {
+        update_view(index);
+        index->view_dirty = false;
+    }
+    return index->match_count;
+}
+
+size_t list_index_get(list_index_t *index, size_t position) {
+    return index->view[position];
+}
@@ -0,0 +1,109 @@
+#ifndef LIST_INDEX_H
+#define LIST_INDEX_H
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+
+typedef enum {
+    LIST_SORT_NONE = 0,     // Order the entries were added in
+    LIST_SORT_NAME,         // Case-insensitive
+    LIST_SORT_SIZE,
+    LIST_SORT_DATE,
+    LIST_SORT_COUNT,
+} list_sort_t;
+
+typedef enum {
+    LIST_FILTER_ALL = 0,
+    LIST_FILTER_DIRECTORIES,
+    LIST_FILTER_FILES,
+    LIST_FILTER_IMAGES,     // Directories and firmware images, to browse towards them
+    LIST_FILTER_COUNT,
+} list_filter_t;
+
+// Sorted, filtered and searched view over a listing, kept as compact keys in PSRAM.
+// Entries are referred to by the position they were added at, so the view can
+// index the listing it was built from.
+typedef struct list_index list_index_t;
+
+/**
+ * @brief Create an empty index, unsorted and unfiltered
+ * @return Index, NULL if out of memory
+ */
+list_index_t *list_index_create(void);
+
+/**
+ * @brief Free an index
+ * @param index Index, may be NULL
+ */
+void list_index_destroy(list_index_t *index);
+
+/**
+ * @brief Remove all entries, keeping sort, filter and query
+ * @param index Index
+ */
+void list_index_clear(list_index_t *index);
+
+/**
+ * @brief Append an entry
+ * The view is brought up to date on the next list_index_count().
+ * @param index Index
+ * @param name Entry name, a case-folded copy is kept
+ * @param is_directory Entry is a directory
+ * @param size Size in bytes
+ * @param mtime Modification time
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t list_index_add(list_index_t *index, const char *name, bool is_directory, size_t size, time_t mtime);
+
+/**
+ * @brief Set the sort order
+ * Name, size and date sorts list directories first. Equal keys keep the order
+ * they were added in.
+ * @param index Index
+ * @param sort Sort key
+ * @param descending Largest, newest or last name first
+ */
+void list_index_set_sort(list_index_t *index, list_sort_t sort, bool descending);
+
+/**
+ * @brief Set which entries are shown
+ * @param index Index
+ * @param filter Filter
+ */
+void list_index_set_filter(list_index_t *index, list_filter_t filter);
+
+/**
+ * @brief Set the search text
+ * Names containing the text come first, then names containing its characters
+ * in order. A query extending the previous one only rechecks the previous
+ * matches, so typing stays cheap on long listings.
+ * @param index Index
+ * @param query Text to look for, case-insensitive. NULL or "" shows everything.
+ */
+void list_index_set_query(list_index_t *index, const char *query);
+
+/**
+ * @brief Check if the view lists every entry in the order it was added
+ * @param index Index
+ * @return true without sort, filter and query
+ */
+bool list_index_is_identity(const list_index_t *index);
+
+/**
+ * @brief Get the number of entries in the view
+ * @param index Index
+ * @return Entries shown
+ */
+size_t list_index_count(list_index_t *index);
+
+/**
+ * @brief Get the entry at a position of the view
+ * @param index Index
+ * @param position Position in the view, below list_index_count()
+ * @return Position the entry was added at
+ */
+size_t list_index_get(list_index_t *index, size_t position);
+
+#endif // LIST_INDEX_H
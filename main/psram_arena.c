@@ -0,0 +1,84 @@
+#include "psram_arena.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+#include <stdint.h>
+
+#define ARENA_ALIGN 8
+
+struct psram_arena_chunk {
+    psram_arena_chunk_t *next;      // Older chunk
+    size_t size;
+    size_t used;
+    uint8_t data[];
+};
+
+static psram_arena_chunk_t *new_chunk(size_t size) {
+    psram_arena_chunk_t *chunk = heap_caps_malloc(sizeof(*chunk) + size, MALLOC_CAP_SPIRAM);
+    if (!chunk) {
+        chunk = heap_caps_malloc(sizeof(*chunk) + size, MALLOC_CAP_DEFAULT);
+    }
+    if (chunk) {
+        chunk->next = NULL;
+        chunk->size = size;
+        chunk->used = 0;
+    }
+    return chunk;
+}
+
+void psram_arena_init(psram_arena_t *arena, size_t chunk_size) {
+    arena->head = NULL;
+    arena->chunk_size = chunk_size;
+}
+
+void *psram_arena_alloc(psram_arena_t *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    psram_arena_chunk_t *chunk = arena->head;
+    if (!chunk || chunk->size - chunk->used < size) {
+        chunk = new_chunk(size > arena->chunk_size ? size : arena->chunk_size);
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->next = arena->head;
+        arena->head = chunk;
+    }
+
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+const char *psram_arena_strdup(psram_arena_t *arena, const char *str) {
+    size_t len = strlen(str) + 1;
+    char *copy = psram_arena_alloc(arena, len);
+    if (copy) {
+        memcpy(copy, str, len);
+    }
+    return copy;
+}
+
+void psram_arena_reset(psram_arena_t *arena) {
+    psram_arena_chunk_t *chunk = arena->head;
+    if (!chunk) {
+        return;
+    }
+
+    // Keep the oldest chunk for the next fill, free the rest
+    while (chunk->next) {
+        psram_arena_chunk_t *next = chunk->next;
+        heap_caps_free(chunk);
+        chunk = next;
+    }
+    chunk->used = 0;
+    arena->head = chunk;
+}
+
+void psram_arena_destroy(psram_arena_t *arena) {
+    psram_arena_chunk_t *chunk = arena->head;
+    while (chunk) {
+        psram_arena_chunk_t *next = chunk->next;
+        heap_caps_free(chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef PSRAM_ARENA_H
+#define PSRAM_ARENA_H
+
+#include <stddef.h>
+
+typedef struct psram_arena_chunk psram_arena_chunk_t;
+
+// Bump allocator over PSRAM chunks, everything is released at once by a reset
+typedef struct {
+    psram_arena_chunk_t *head;      // Chunk allocations come from, newest first
+    size_t chunk_size;              // Payload size of each new chunk
+} psram_arena_t;
+
+/**
+ * @brief Initialize an empty arena, no memory is allocated until first use
+ * @param arena Arena
+ * @param chunk_size Bytes per chunk, larger requests get a chunk of their own
+ */
+void psram_arena_init(psram_arena_t *arena, size_t chunk_size);
+
+/**
+ * @brief Allocate from the arena
+ * @param arena Arena
+ * @param size Bytes, the result is aligned for any type
+ * @return Memory valid until the next reset, NULL if out of memory
+ */
+void *psram_arena_alloc(psram_arena_t *arena, size_t size);
+
+/**
+ * @brief Copy a string into the arena
+ * @param arena Arena
+ * @param str String to copy
+ * @return Copy valid until the next reset, NULL if out of memory
+ */
+const char *psram_arena_strdup(psram_arena_t *arena, const char *str);
+
+/**
+ * @brief Release every allocation
+ * The first chunk is kept for reuse so refilling the arena does not touch the heap.
+ * @param arena Arena
+ */
+void psram_arena_reset(psram_arena_t *arena);
+
+/**
+ * @brief Release every allocation and all chunks
+ * @param arena Arena
+ */
+void psram_arena_destroy(psram_arena_t *arena);
+
+#endif // PSRAM_ARENA_H
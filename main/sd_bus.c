@@ -0,0 +1,224 @@
+#include "sd_bus.h"
+#include "bsp/m5stack_tab5.h"
+#include "sdmmc_cmd.h"
+#include "driver/sdmmc_host.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#include <string.h>
+#include <inttypes.h>
+
+static const char *TAG = "SD_BUS";
+
+#define SD_BUS_FREQ_50M     50000               // High speed limit of the SD spec
+
+static uint32_t mounted_freq = 0;
+
+static esp_err_t mount_at(char *mount_point, size_t max_files, uint32_t freq) {
+    if (bsp_sdcard_get_handle()) {
+        bsp_sdcard_deinit(mount_point);
+    }
+    mounted_freq = 0;
+    esp_err_t ret = bsp_sdcard_init_with_freq(mount_point, max_files, freq);
+    if (ret == ESP_OK) {
+        mounted_freq = freq;
+    }
+    return ret;
+}
+
+#if CONFIG_LAUNCHER_SD_BUS_PROBE
+static const char *NVS_NAMESPACE = "launcher";
+static const char *NVS_KEY_KNOWN_CARDS = "sd_cards";
+
+#define KNOWN_CARDS_MAX     8
+#define BENCH_CHUNK         (64 * 1024)
+#define BENCH_BYTES         (1024 * 1024)
+
+// Candidates, fastest first. All of them use 3.3 V signalling: the card has no
+// power switch, so a card moved to 1.8 V for UHS-I could not be brought back.
+static const uint32_t candidate_freqs[] = { SD_BUS_FREQ_50M, SDMMC_FREQ_HIGHSPEED, SDMMC_FREQ_DEFAULT };
+
+typedef struct {
+    uint32_t cid_hash;                      // CRC32 of the card's CID
+    uint32_t freq;                          // Best clock in kHz
+} known_card_t;
+
+// One NVS entry, most recently mounted card first. The oldest card drops off
+// when the table is full and is probed again if it comes back.
+static known_card_t known_cards[KNOWN_CARDS_MAX];
+static size_t known_card_count = 0;
+static bool known_cards_loaded = false;
+
+static uint32_t card_hash(const sdmmc_card_t *card) {
+    return esp_rom_crc32_le(0, (const uint8_t *)card->raw_cid, sizeof(card->raw_cid));
+}
+
+static void load_known_cards(void) {
+    if (known_cards_loaded) {
+        return;
+    }
+    known_cards_loaded = true;
+
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return;
+    }
+    size_t size = sizeof(known_cards);
+    if (nvs_get_blob(nvs_handle, NVS_KEY_KNOWN_CARDS, known_cards, &size) == ESP_OK) {
+        known_card_count = size / sizeof(known_card_t);
+    }
+    nvs_close(nvs_handle);
+}
+
+static bool find_known_card(uint32_t cid_hash, uint32_t *freq) {
+    for (size_t i = 0; i < known_card_count; i++) {
+        if (known_cards[i].cid_hash == cid_hash) {
+            *freq = known_cards[i].freq;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Move the card to the front, only written to NVS if the table changed
+static void remember_card(uint32_t cid_hash, uint32_t freq) {
+    if (known_card_count > 0 && known_cards[0].cid_hash == cid_hash && known_cards[0].freq == freq) {
+        return;
+    }
+
+    size_t i = 0;
+    while (i < known_card_count && known_cards[i].cid_hash != cid_hash) {
+        i++;
+    }
+    if (i == known_card_count) {
+        if (known_card_count < KNOWN_CARDS_MAX) {
+            known_card_count++;
+        }
+        i = known_card_count - 1;
+    }
+    memmove(&known_cards[1], &known_cards[0], i * sizeof(known_card_t));
+    known_cards[0] = (known_card_t) { .cid_hash = cid_hash, .freq = freq };
+
+    nvs_handle_t nvs_handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (ret == ESP_OK) {
+        ret = nvs_set_blob(nvs_handle, NVS_KEY_KNOWN_CARDS, known_cards, known_card_count * sizeof(known_card_t));
+        if (ret == ESP_OK) {
+            ret = nvs_commit(nvs_handle);
+        }
+        nvs_close(nvs_handle);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to save known cards: %s", esp_err_to_name(ret));
+    }
+}
+
+static esp_err_t bench_read(sdmmc_card_t *card, uint32_t *kbps) {
+    size_t sector_size = card->csd.sector_size;
+    size_t sectors_per_chunk = BENCH_CHUNK / sector_size;
+    size_t chunks = BENCH_BYTES / BENCH_CHUNK;
+    if ((size_t)card->csd.capacity < sectors_per_chunk * chunks) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint8_t *buffer = heap_caps_malloc(BENCH_CHUNK, MALLOC_CAP_DMA);
+    if (!buffer) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Raw sectors from the start of the card, the filesystem is not involved
+    esp_err_t ret = ESP_OK;
+    int64_t start = esp_timer_get_time();
+    for (size_t i = 0; i < chunks && ret == ESP_OK; i++) {
+        ret = sdmmc_read_sectors(card, buffer, i * sectors_per_chunk, sectors_per_chunk);
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+    heap_caps_free(buffer);
+
+    if (ret == ESP_OK) {
+        *kbps = (uint32_t)((int64_t)BENCH_BYTES * 1000 / (elapsed > 0 ? elapsed : 1));
+    }
+    return ret;
+}
+
+static uint32_t probe(char *mount_point, size_t max_files) {
+    uint32_t best_freq = 0;
+    uint32_t best_kbps = 0;
+    for (size_t i = 0; i < sizeof(candidate_freqs) / sizeof(candidate_freqs[0]); i++) {
+        uint32_t freq = candidate_freqs[i];
+        esp_err_t ret = mount_at(mount_point, max_files, freq);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "%" PRIu32 " kHz: mount failed (%s)", freq, esp_err_to_name(ret));
+            continue;
+        }
+        uint32_t kbps = 0;
+        ret = bench_read(bsp_sdcard_get_handle(), &kbps);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "%" PRIu32 " kHz: read failed (%s)", freq, esp_err_to_name(ret));
+            continue;
+        }
+        ESP_LOGI(TAG, "%" PRIu32 " kHz: %" PRIu32 " KB/s", freq, kbps);
+        // A card that tops out below a candidate runs every faster candidate
+        // at the same clock, ties keep the faster setting
+        if (kbps > best_kbps) {
+            best_kbps = kbps;
+            best_freq = freq;
+        }
+    }
+    return best_freq;
+}
+
+#endif // CONFIG_LAUNCHER_SD_BUS_PROBE
+
+esp_err_t sd_bus_mount(char *mount_point, size_t max_files) {
+#if !CONFIG_LAUNCHER_SD_BUS_PROBE
+    return mount_at(mount_point, max_files, SDMMC_FREQ_HIGHSPEED);
+#else
+    // Usually the card from the last boot, so its clock is tried first
+    load_known_cards();
+    uint32_t freq = known_card_count > 0 ? known_cards[0].freq : SDMMC_FREQ_HIGHSPEED;
+    esp_err_t ret = mount_at(mount_point, max_files, freq);
+    if (ret != ESP_OK && freq != SDMMC_FREQ_DEFAULT) {
+        ret = mount_at(mount_point, max_files, SDMMC_FREQ_DEFAULT);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    uint32_t cid_hash = card_hash(bsp_sdcard_get_handle());
+    uint32_t known_freq;
+    if (find_known_card(cid_hash, &known_freq)) {
+        if (known_freq == mounted_freq ||
+            mount_at(mount_point, max_files, known_freq) == ESP_OK) {
+            remember_card(cid_hash, known_freq);
+            ESP_LOGI(TAG, "Card %08" PRIx32 " mounted at %" PRIu32 " kHz", cid_hash, known_freq);
+            return ESP_OK;
+        }
+        ESP_LOGW(TAG, "Card %08" PRIx32 " no longer mounts at %" PRIu32 " kHz, probing again", cid_hash, known_freq);
+    }
+
+    ESP_LOGI(TAG, "New card %08" PRIx32 ", probing bus clocks", cid_hash);
+    uint32_t best_freq = probe(mount_point, max_files);
+    if (best_freq == 0) {
+        // Nothing read cleanly, mount as slow as possible and do not remember it
+        ESP_LOGE(TAG, "No bus clock passed the read test");
+        return mount_at(mount_point, max_files, SDMMC_FREQ_DEFAULT);
+    }
+    if (best_freq != mounted_freq) {
+        ret = mount_at(mount_point, max_files, best_freq);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    remember_card(cid_hash, best_freq);
+    ESP_LOGI(TAG, "Card %08" PRIx32 " mounted at %" PRIu32 " kHz", cid_hash, best_freq);
+    return ESP_OK;
+#endif
+}
+
+uint32_t sd_bus_get_freq_khz(void) {
+    return mounted_freq;
+}
@@ -0,0 +1,26 @@
+#ifndef SD_BUS_H
+#define SD_BUS_H
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Mount the SD card at the fastest bus clock it reads reliably at
+ * The clock is found once per card: each candidate is mounted and read from,
+ * clocks that fail to mount or return CRC errors are skipped, and the one with
+ * the best throughput is kept in NVS for the last 8 cards, by CID. NVS has
+ * to be initialized before.
+ * @param mount_point Path to register the FAT filesystem at
+ * @param max_files Maximum number of files open at the same time
+ * @return ESP_OK on success, error of the last mount attempt otherwise
+ */
+esp_err_t sd_bus_mount(char *mount_point, size_t max_files);
+
+/**
+ * @brief Get the bus clock the card was mounted with
+ * @return Clock limit in kHz, 0 if sd_bus_mount() did not succeed
+ */
+uint32_t sd_bus_get_freq_khz(void);
+
+#endif // SD_BUS_H
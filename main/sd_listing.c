@@ -0,0 +1,84 @@
+#include "sd_listing.h"
+#include "psram_arena.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+
+#define NAME_ARENA_CHUNK   (16 * 1024)
+#define INITIAL_CAPACITY   64
+
+struct sd_listing {
+    file_entry_t *entries;          // PSRAM array, grows by doubling
+    size_t count;
+    size_t capacity;
+    psram_arena_t names;            // Entry names, so entries stay fixed size
+};
+
+sd_listing_t *sd_listing_create(void) {
+    sd_listing_t *listing = heap_caps_calloc(1, sizeof(*listing), MALLOC_CAP_SPIRAM);
+    if (!listing) {
+        listing = heap_caps_calloc(1, sizeof(*listing), MALLOC_CAP_DEFAULT);
+    }
+    if (listing) {
+        psram_arena_init(&listing->names, NAME_ARENA_CHUNK);
+    }
+    return listing;
+}
+
+void sd_listing_destroy(sd_listing_t *listing) {
+    if (!listing) {
+        return;
+    }
+    psram_arena_destroy(&listing->names);
+    heap_caps_free(listing->entries);
+    heap_caps_free(listing);
+}
+
+void sd_listing_clear(sd_listing_t *listing) {
+    listing->count = 0;
+    psram_arena_reset(&listing->names);
+}
+
+esp_err_t sd_listing_add(sd_listing_t *listing, const char *name, bool is_directory, size_t size, time_t mtime) {
+    if (listing->count == listing->capacity) {
+        size_t capacity = listing->capacity ? listing->capacity * 2 : INITIAL_CAPACITY;
+        file_entry_t *entries = heap_caps_realloc(listing->entries, capacity * sizeof(file_entry_t), MALLOC_CAP_SPIRAM);
+        if (!entries) {
+            return ESP_ERR_NO_MEM;
+        }
+        listing->entries = entries;
+        listing->capacity = capacity;
+    }
+
+    const char *interned = psram_arena_strdup(&listing->names, name);
+    if (!interned) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    listing->entries[listing->count++] = (file_entry_t) {
+        .name = interned,
+        .is_directory = is_directory,
+        .size = size,
+        .mtime = mtime,
+    };
+    return ESP_OK;
+}
+
+size_t sd_listing_count(const sd_listing_t *listing) {
+    return listing ? listing->count : 0;
+}
+
+const file_entry_t *sd_listing_get(const sd_listing_t *listing, size_t index) {
+    if (!listing || index >= listing->count) {
+        return NULL;
+    }
+    return &listing->entries[index];
+}
+
+size_t sd_listing_page(const sd_listing_t *listing, size_t first, size_t max, const file_entry_t **page) {
+    if (!listing || first >= listing->count) {
+        *page = NULL;
+        return 0;
+    }
+    *page = &listing->entries[first];
+    return (listing->count - first < max) ? listing->count - first : max;
+}
@@ -0,0 +1,73 @@
+#ifndef SD_LISTING_H
+#define SD_LISTING_H
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+
+typedef struct {
+    const char *name;   // Interned in the listing, valid until it is cleared
+    bool is_directory;
+    size_t size;
+    time_t mtime;       // Last modification time, local time as stored by FAT
+} file_entry_t;
+
+// Directory listing of any length, entries and names live in PSRAM
+typedef struct sd_listing sd_listing_t;
+
+/**
+ * @brief Create an empty listing
+ * @return Listing, NULL if out of memory
+ */
+sd_listing_t *sd_listing_create(void);
+
+/**
+ * @brief Free a listing and all its entries
+ * @param listing Listing, may be NULL
+ */
+void sd_listing_destroy(sd_listing_t *listing);
+
+/**
+ * @brief Remove all entries, keeping the memory for the next fill
+ * @param listing Listing
+ */
+void sd_listing_clear(sd_listing_t *listing);
+
+/**
+ * @brief Append an entry
+ * @param listing Listing
+ * @param name Entry name, copied
+ * @param is_directory Entry is a directory
+ * @param size File size in bytes
+ * @param mtime Modification time
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t sd_listing_add(sd_listing_t *listing, const char *name, bool is_directory, size_t size, time_t mtime);
+
+/**
+ * @brief Get the number of entries
+ * @param listing Listing
+ * @return Entry count
+ */
+size_t sd_listing_count(const sd_listing_t *listing);
+
+/**
+ * @brief Get one entry
+ * @param listing Listing
+ * @param index Entry index
+ * @return Entry, NULL if index is out of range. Valid until the listing changes.
+ */
+const file_entry_t *sd_listing_get(const sd_listing_t *listing, size_t index);
+
+/**
+ * @brief Get a page of consecutive entries
+ * @param listing Listing
+ * @param first Index of the first entry of the page
+ * @param max Page size
+ * @param page Output, first entry of the page. Valid until the listing changes.
+ * @return Number of entries in the page, 0 once first is past the end
+ */
+size_t sd_listing_page(const sd_listing_t *listing, size_t first, size_t max, const file_entry_t **page);
+
+#endif // SD_LISTING_H
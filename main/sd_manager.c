@@ -1,25 +1,80 @@
 #include "sd_manager.h"
+#include "sd_bus.h"
 #include "esp_log.h"
 #include "esp_vfs_fat.h"
 #include "driver/sdmmc_host.h"
 #include "driver/sdspi_host.h"
 #include "sdmmc_cmd.h"
 #include "bsp/m5stack_tab5.h"
-#include <dirent.h>
+#include "ff.h"
+#include "diskio_sdmmc.h"
+#include "esp_heap_caps.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "mbedtls/sha256.h"
+#include <stdatomic.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 
 static const char *TAG = "SD_MANAGER";
 static bool sd_mounted = false;
+static BYTE sd_pdrv = 0;     // FatFs drive number the card is mounted as
+
+#define SD_TASK_STACK       6144        // Remounting runs on the SD task
+#define SD_TASK_PRIORITY    4           // Above firmware discovery, below the flash task
+#define SD_HIGH_QUEUE_LEN   8
+#define SD_LOW_QUEUE_LEN    16
+#define SD_IO_SLICE         (32 * 1024) // Bulk work checks for high priority requests this often
+#define SD_LIST_SLICE       64          // Same for listings, in directory entries
+#define SD_MAX_FILES        5
+#define SD_MAX_CARD_CALLBACKS 4
+
+static TaskHandle_t sd_task_handle = NULL;
+static QueueHandle_t high_queue = NULL;
+static QueueHandle_t low_queue = NULL;
+static SemaphoreHandle_t pending = NULL;    // One count per queued request
+static uint8_t *io_buffer = NULL;           // Slice buffer, only used by the SD task
+
+static atomic_uint card_generation;
+static int card_users = 0;                  // A card in use through raw files or stdio is not unmounted under them
+static portMUX_TYPE card_use_lock = portMUX_INITIALIZER_UNLOCKED;
+static TickType_t mount_backoff = 0;        // Extra wait before mounting a card that failed to, SD task only
+static TickType_t last_mount_attempt = 0;
+static portMUX_TYPE card_callback_lock = portMUX_INITIALIZER_UNLOCKED;
+static struct {
+    sd_card_callback_t callback;
+    void *user_data;
+} card_callbacks[SD_MAX_CARD_CALLBACKS];
+
+static esp_err_t start_service(void);
+
+static esp_err_t mount_card(void) {
+    esp_err_t ret = sd_bus_mount(SD_MOUNT_POINT, SD_MAX_FILES);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    sd_pdrv = ff_diskio_get_pdrv_card(bsp_sdcard_get_handle());
+    if (sd_pdrv == 0xFF) {
+        ESP_LOGE(TAG, "Mounted card has no FatFs drive");
+        bsp_sdcard_deinit(SD_MOUNT_POINT);
+        return ESP_ERR_NOT_FOUND;
+    }
+    sd_mounted = true;
+    atomic_fetch_add(&card_generation, 1);
+    return ESP_OK;
+}
 
 esp_err_t sd_manager_init(void) {
-    esp_err_t ret = bsp_sdcard_init(SD_MOUNT_POINT, 5);
+    esp_err_t ret = mount_card();
     if (ret == ESP_OK) {
-        sd_mounted = true;
         ESP_LOGI(TAG, "SD card mounted successfully at %s", SD_MOUNT_POINT);
     } else {
         ESP_LOGE(TAG, "Failed to mount SD card: %s", esp_err_to_name(ret));
-        sd_mounted = false;
+    }
+    // Started without a card too, the SD task picks one up once inserted
+    if (start_service() != ESP_OK) {
+        ESP_LOGW(TAG, "SD service unavailable, card I/O runs on the calling task");
     }
     return ret;
 }
@@ -36,88 +91,560 @@ esp_err_t sd_manager_deinit(void) {
     esp_err_t ret = bsp_sdcard_deinit(SD_MOUNT_POINT);
     if (ret == ESP_OK) {
         sd_mounted = false;
+        atomic_fetch_add(&card_generation, 1);
         ESP_LOGI(TAG, "SD card unmounted successfully");
     }
     return ret;
 }
 
-int sd_manager_scan_directory(const char *path, file_entry_t *entries, int max_entries) {
-    if (!sd_mounted) {
-        ESP_LOGE(TAG, "SD card not mounted");
-        return -1;
-    }
-    
-    char full_path[256];
-    snprintf(full_path, sizeof(full_path), "%s%s", SD_MOUNT_POINT, path);
+// FAT stores local date and time split into bit fields
+static time_t fat_time_to_time_t(WORD fdate, WORD ftime) {
+    struct tm tm = {
+        .tm_year = ((fdate >> 9) & 0x7F) + 80,
+        .tm_mon = ((fdate >> 5) & 0x0F) - 1,
+        .tm_mday = fdate & 0x1F,
+        .tm_hour = (ftime >> 11) & 0x1F,
+        .tm_min = (ftime >> 5) & 0x3F,
+        .tm_sec = (ftime & 0x1F) * 2,
+        .tm_isdst = -1,
+    };
+    return mktime(&tm);
+}
+
+static void serve_urgent(void);
+
+static int list_directory(const char *path, sd_listing_t *listing, bool urgent) {
+    // Go to FatFs directly: readdir() + stat() re-walks the directory for every
+    // entry, f_readdir() already has name, size, attributes and date at hand
+    char fatfs_path[256];
+    snprintf(fatfs_path, sizeof(fatfs_path), "%u:%s", (unsigned)sd_pdrv, path);
     
-    DIR *dir = opendir(full_path);
-    if (!dir) {
-        ESP_LOGE(TAG, "Failed to open directory: %s", full_path);
+    FF_DIR dir;
+    FRESULT res = f_opendir(&dir, fatfs_path);
+    if (res != FR_OK) {
+        ESP_LOGE(TAG, "Failed to open directory: %s (%d)", path, (int)res);
         return -1;
     }
     
-    struct dirent *entry;
+    FILINFO info;
     int count = 0;
+    sd_listing_clear(listing);
     
-    while ((entry = readdir(dir)) != NULL && count < max_entries) {
+    while (f_readdir(&dir, &info) == FR_OK && info.fname[0] != '\0') {
         // Skip hidden files and current/parent directory entries
-        if (entry->d_name[0] == '.') {
+        if (info.fname[0] == '.') {
             continue;
         }
         
-        // Get full path for stat
-        char item_path[512];
-        snprintf(item_path, sizeof(item_path), "%s/%s", full_path, entry->d_name);
-        
-        struct stat file_stat;
-        if (stat(item_path, &file_stat) == 0) {
-            strncpy(entries[count].name, entry->d_name, sizeof(entries[count].name) - 1);
-            entries[count].name[sizeof(entries[count].name) - 1] = '\0';
-            entries[count].is_directory = S_ISDIR(file_stat.st_mode);
-            entries[count].size = file_stat.st_size;
-            count++;
+        if (sd_listing_add(listing, info.fname, (info.fattrib & AM_DIR) != 0, info.fsize,
+                           fat_time_to_time_t(info.fdate, info.ftime)) != ESP_OK) {
+            ESP_LOGW(TAG, "Out of memory, listing of %s truncated at %d entries", path, count);
+            break;
+        }
+        count++;
+        if (!urgent && count % SD_LIST_SLICE == 0) {
+            serve_urgent();
         }
     }
     
-    closedir(dir);
+    f_closedir(&dir);
     ESP_LOGI(TAG, "Found %d entries in %s", count, path);
     return count;
 }
 
-bool sd_manager_file_exists(const char *path) {
-    if (!sd_mounted) {
-        return false;
+esp_err_t sd_manager_fs_acquire(void) {
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+    taskENTER_CRITICAL(&card_use_lock);
+    if (sd_mounted) {
+        card_users++;
+        ret = ESP_OK;
+    }
+    taskEXIT_CRITICAL(&card_use_lock);
+    return ret;
+}
+
+void sd_manager_fs_release(void) {
+    taskENTER_CRITICAL(&card_use_lock);
+    card_users--;
+    taskEXIT_CRITICAL(&card_use_lock);
+}
+
+FILE* sd_manager_open_file(const char *path, const char *mode) {
+    if (sd_manager_fs_acquire() != ESP_OK) {
+        return NULL;
     }
     
     char full_path[256];
     snprintf(full_path, sizeof(full_path), "%s%s", SD_MOUNT_POINT, path);
     
-    struct stat file_stat;
-    return (stat(full_path, &file_stat) == 0);
+    FILE *file = fopen(full_path, mode);
+    if (!file) {
+        sd_manager_fs_release();
+    }
+    return file;
 }
 
-size_t sd_manager_get_file_size(const char *path) {
-    if (!sd_mounted) {
-        return 0;
+int sd_manager_close_file(FILE *file) {
+    int ret = fclose(file);
+    sd_manager_fs_release();
+    return ret;
+}
+
+struct sd_raw_file {
+    FIL fil;
+    size_t cluster_size;
+};
+
+void *sd_manager_raw_alloc(size_t size) {
+    void *buf = heap_caps_aligned_alloc(SD_RAW_BUFFER_ALIGN, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_DMA);
+    if (!buf) {
+        buf = heap_caps_aligned_alloc(SD_RAW_BUFFER_ALIGN, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA);
+    }
+    return buf;
+}
+
+esp_err_t sd_manager_raw_open(const char *path, sd_raw_file_t **out) {
+    esp_err_t ret = sd_manager_fs_acquire();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    sd_raw_file_t *file = calloc(1, sizeof(sd_raw_file_t));
+    if (!file) {
+        sd_manager_fs_release();
+        return ESP_ERR_NO_MEM;
+    }
+    
+    char fatfs_path[256];
+    snprintf(fatfs_path, sizeof(fatfs_path), "%u:%s", (unsigned)sd_pdrv, path);
+    FRESULT res = f_open(&file->fil, fatfs_path, FA_READ);
+    if (res != FR_OK) {
+        free(file);
+        sd_manager_fs_release();
+        return (res == FR_NO_FILE || res == FR_NO_PATH) ? ESP_ERR_NOT_FOUND : ESP_FAIL;
     }
     
+    FATFS *fs = file->fil.obj.fs;
+#if FF_MAX_SS != FF_MIN_SS
+    file->cluster_size = (size_t)fs->csize * fs->ssize;
+#else
+    file->cluster_size = (size_t)fs->csize * FF_MAX_SS;
+#endif
+    *out = file;
+    return ESP_OK;
+}
+
+esp_err_t sd_manager_raw_read(sd_raw_file_t *file, void *buf, size_t len, size_t *out_len) {
+    UINT got = 0;
+    FRESULT res = f_read(&file->fil, buf, len, &got);
+    *out_len = got;
+    if (res != FR_OK) {
+        ESP_LOGE(TAG, "Raw read failed (%d)", (int)res);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t sd_manager_raw_seek(sd_raw_file_t *file, size_t offset) {
+    // f_lseek() on a read-only file stops at the end instead of failing
+    if (offset > f_size(&file->fil)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return f_lseek(&file->fil, offset) == FR_OK ? ESP_OK : ESP_FAIL;
+}
+
+size_t sd_manager_raw_size(const sd_raw_file_t *file) {
+    return f_size(&file->fil);
+}
+
+size_t sd_manager_raw_cluster_size(const sd_raw_file_t *file) {
+    return file->cluster_size;
+}
+
+void sd_manager_raw_close(sd_raw_file_t *file) {
+    if (!file) {
+        return;
+    }
+    f_close(&file->fil);
+    free(file);
+    sd_manager_fs_release();
+}
+
+static void build_path(char *full_path, size_t size, const char *path) {
+    snprintf(full_path, size, "%s%s", SD_MOUNT_POINT, path);
+}
+
+static esp_err_t stat_file(sd_request_t *request) {
     char full_path[256];
-    snprintf(full_path, sizeof(full_path), "%s%s", SD_MOUNT_POINT, path);
+    build_path(full_path, sizeof(full_path), request->path);
     
     struct stat file_stat;
-    if (stat(full_path, &file_stat) == 0) {
-        return file_stat.st_size;
+    if (stat(full_path, &file_stat) != 0) {
+        return ESP_ERR_NOT_FOUND;
     }
-    return 0;
+    request->stat.size = file_stat.st_size;
+    request->stat.mtime = file_stat.st_mtime;
+    request->stat.is_directory = S_ISDIR(file_stat.st_mode);
+    return ESP_OK;
 }
 
-FILE* sd_manager_open_file(const char *path, const char *mode) {
-    if (!sd_mounted) {
-        return NULL;
+static esp_err_t read_file(sd_request_t *request, bool urgent) {
+    char full_path[256];
+    build_path(full_path, sizeof(full_path), request->path);
+    
+    request->read.bytes_read = 0;
+    FILE *file = fopen(full_path, "rb");
+    if (!file) {
+        return ESP_ERR_NOT_FOUND;
     }
     
+    esp_err_t ret = ESP_OK;
+    if (fseek(file, request->read.offset, SEEK_SET) != 0) {
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t *out = request->read.buffer;
+    while (ret == ESP_OK && request->read.bytes_read < request->read.length) {
+        size_t want = request->read.length - request->read.bytes_read;
+        if (want > SD_IO_SLICE) {
+            want = SD_IO_SLICE;
+        }
+        size_t n = fread(out + request->read.bytes_read, 1, want, file);
+        request->read.bytes_read += n;
+        if (n < want) {
+            ret = ferror(file) ? ESP_FAIL : ESP_OK;
+            break;
+        }
+        if (!urgent) {
+            serve_urgent();
+        }
+    }
+    fclose(file);
+    return ret;
+}
+
+static esp_err_t hash_file(sd_request_t *request, bool urgent) {
     char full_path[256];
-    snprintf(full_path, sizeof(full_path), "%s%s", SD_MOUNT_POINT, path);
+    build_path(full_path, sizeof(full_path), request->path);
+    
+    FILE *file = fopen(full_path, "rb");
+    if (!file) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    
+    size_t n;
+    while ((n = fread(io_buffer, 1, SD_IO_SLICE, file)) > 0) {
+        mbedtls_sha256_update(&ctx, io_buffer, n);
+        if (!urgent) {
+            serve_urgent();
+        }
+    }
+    esp_err_t ret = ferror(file) ? ESP_FAIL : ESP_OK;
+    mbedtls_sha256_finish(&ctx, request->hash.digest);
+    mbedtls_sha256_free(&ctx);
+    fclose(file);
+    return ret;
+}
+
+static esp_err_t copy_file(sd_request_t *request, bool urgent) {
+    char src_path[256];
+    char dest_path[256];
+    build_path(src_path, sizeof(src_path), request->path);
+    build_path(dest_path, sizeof(dest_path), request->copy.dest_path);
+    
+    request->copy.bytes_copied = 0;
+    FILE *src = fopen(src_path, "rb");
+    if (!src) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    FILE *dest = fopen(dest_path, "wb");
+    if (!dest) {
+        fclose(src);
+        return ESP_FAIL;
+    }
+    
+    esp_err_t ret = ESP_OK;
+    size_t n;
+    while ((n = fread(io_buffer, 1, SD_IO_SLICE, src)) > 0) {
+        if (fwrite(io_buffer, 1, n, dest) != n) {
+            ret = ESP_FAIL;
+            break;
+        }
+        request->copy.bytes_copied += n;
+        if (!urgent) {
+            serve_urgent();
+        }
+    }
+    if (ret == ESP_OK && ferror(src)) {
+        ret = ESP_FAIL;
+    }
+    fclose(src);
+    if (fclose(dest) != 0) {
+        ret = ESP_FAIL;
+    }
+    if (ret != ESP_OK) {
+        remove(dest_path);
+    }
+    return ret;
+}
+
+static void process(sd_request_t *request, bool urgent) {
+    if (!sd_mounted) {
+        request->result = ESP_ERR_INVALID_STATE;
+    } else {
+        switch (request->type) {
+            case SD_REQUEST_LIST:
+                request->list.count = list_directory(request->path, request->list.listing, urgent);
+                request->result = request->list.count < 0 ? ESP_FAIL : ESP_OK;
+                break;
+            case SD_REQUEST_STAT:
+                request->result = stat_file(request);
+                break;
+            case SD_REQUEST_READ:
+                request->result = read_file(request, urgent);
+                break;
+            case SD_REQUEST_HASH:
+                request->result = hash_file(request, urgent);
+                break;
+            case SD_REQUEST_COPY:
+                request->result = copy_file(request, urgent);
+                break;
+            default:
+                request->result = ESP_ERR_NOT_SUPPORTED;
+                break;
+        }
+    }
+    
+    // The request may be reused as soon as it is signalled, read everything first
+    EventGroupHandle_t done_group = request->done_group;
+    EventBits_t done_bits = request->done_bits;
+    TaskHandle_t waiter = request->waiter;
+    if (request->callback) {
+        request->callback(request);
+    }
+    if (done_group) {
+        xEventGroupSetBits(done_group, done_bits);
+    }
+    if (waiter) {
+        xTaskNotifyGive(waiter);
+    }
+}
+
+static void serve_urgent(void) {
+    sd_request_t *request;
+    while (xQueueReceive(high_queue, &request, 0) == pdTRUE) {
+        xSemaphoreTake(pending, 0);
+        process(request, true);
+    }
+}
+
+static void notify_card(sd_card_event_t event) {
+    sd_card_callback_t callbacks[SD_MAX_CARD_CALLBACKS];
+    void *user_data[SD_MAX_CARD_CALLBACKS];
+    taskENTER_CRITICAL(&card_callback_lock);
+    for (int i = 0; i < SD_MAX_CARD_CALLBACKS; i++) {
+        callbacks[i] = card_callbacks[i].callback;
+        user_data[i] = card_callbacks[i].user_data;
+    }
+    taskEXIT_CRITICAL(&card_callback_lock);
+    
+    for (int i = 0; i < SD_MAX_CARD_CALLBACKS; i++) {
+        if (callbacks[i]) {
+            callbacks[i](event, user_data[i]);
+        }
+    }
+}
+
+static bool card_responds(void) {
+    sdmmc_card_t *card = bsp_sdcard_get_handle();
+    // Asked twice, a single failed status poll may just be noise on the bus
+    for (int i = 0; i < 2; i++) {
+        if (card && sdmmc_get_status(card) == ESP_OK) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The slot has no card detect line, so presence is polled between requests
+static void check_card(void) {
+    if (sd_mounted) {
+        if (card_responds()) {
+            return;
+        }
+        // Taken together with the flag, so no new user slips in before the unmount
+        taskENTER_CRITICAL(&card_use_lock);
+        bool in_use = card_users > 0;
+        if (!in_use) {
+            sd_mounted = false;
+        }
+        taskEXIT_CRITICAL(&card_use_lock);
+        if (in_use) {
+            // Their reads fail from now on; unmount once the users gave up
+            ESP_LOGW(TAG, "SD card not responding, waiting for open files to close");
+            return;
+        }
+        ESP_LOGW(TAG, "SD card removed");
+        bsp_sdcard_deinit(SD_MOUNT_POINT);
+        atomic_fetch_add(&card_generation, 1);
+        notify_card(SD_CARD_REMOVED);
+        return;
+    }
+    
+    // Identify the card before mounting, an empty slot then costs one command
+    // sequence instead of a mount attempt at every bus clock
+    if (!bsp_sdcard_detect()) {
+        mount_backoff = 0;
+        return;
+    }
+    if (xTaskGetTickCount() - last_mount_attempt < mount_backoff) {
+        return;
+    }
+    last_mount_attempt = xTaskGetTickCount();
+    
+    if (mount_card() == ESP_OK) {
+        mount_backoff = 0;
+        ESP_LOGI(TAG, "SD card inserted, mounted at %s", SD_MOUNT_POINT);
+        notify_card(SD_CARD_INSERTED);
+        return;
+    }
+    
+    // A card that answers but will not mount, e.g. unformatted, is retried less often
+    const TickType_t backoff_max = pdMS_TO_TICKS(SD_PRESENCE_BACKOFF_MS - SD_PRESENCE_POLL_MS);
+    mount_backoff = mount_backoff == 0 ? pdMS_TO_TICKS(SD_PRESENCE_POLL_MS) : mount_backoff * 2;
+    if (mount_backoff > backoff_max) {
+        mount_backoff = backoff_max;
+    }
+}
+
+static void sd_task(void *arg) {
+    const TickType_t poll_interval = pdMS_TO_TICKS(SD_PRESENCE_POLL_MS);
+    TickType_t last_check = xTaskGetTickCount();
+    while (true) {
+        if (xSemaphoreTake(pending, poll_interval) == pdTRUE) {
+            sd_request_t *request;
+            if (xQueueReceive(high_queue, &request, 0) == pdTRUE) {
+                process(request, true);
+            } else if (xQueueReceive(low_queue, &request, 0) == pdTRUE) {
+                process(request, false);
+            }
+        }
+        // Also checked under a steady stream of requests
+        if (xTaskGetTickCount() - last_check >= poll_interval) {
+            check_card();
+            last_check = xTaskGetTickCount();
+        }
+    }
+}
+
+static esp_err_t start_service(void) {
+    if (sd_task_handle) {
+        return ESP_OK;
+    }
+    
+    io_buffer = heap_caps_malloc(SD_IO_SLICE, MALLOC_CAP_DMA);
+    if (!io_buffer) {
+        io_buffer = heap_caps_malloc(SD_IO_SLICE, MALLOC_CAP_DEFAULT);
+    }
+    high_queue = xQueueCreate(SD_HIGH_QUEUE_LEN, sizeof(sd_request_t *));
+    low_queue = xQueueCreate(SD_LOW_QUEUE_LEN, sizeof(sd_request_t *));
+    pending = xSemaphoreCreateCounting(SD_HIGH_QUEUE_LEN + SD_LOW_QUEUE_LEN, 0);
+    if (!io_buffer || !high_queue || !low_queue || !pending) {
+        ESP_LOGE(TAG, "Failed to allocate SD service");
+        return ESP_ERR_NO_MEM;
+    }
     
-    return fopen(full_path, mode);
-}
\ No newline at end of file
+    // CPU1 with the other storage tasks, LVGL keeps CPU0
+    if (xTaskCreatePinnedToCore(sd_task, "sd_io", SD_TASK_STACK, NULL, SD_TASK_PRIORITY, &sd_task_handle, 1) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create SD task");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t enqueue(sd_request_t *request, sd_priority_t priority) {
+    if (!sd_task_handle) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    QueueHandle_t queue = priority == SD_PRIORITY_HIGH ? high_queue : low_queue;
+    if (xQueueSend(queue, &request, portMAX_DELAY) != pdTRUE) {
+        return ESP_FAIL;
+    }
+    xSemaphoreGive(pending);
+    return ESP_OK;
+}
+
+uint32_t sd_manager_get_card_generation(void) {
+    return atomic_load(&card_generation);
+}
+
+esp_err_t sd_manager_add_card_callback(sd_card_callback_t callback, void *user_data) {
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    taskENTER_CRITICAL(&card_callback_lock);
+    for (int i = 0; i < SD_MAX_CARD_CALLBACKS; i++) {
+        if (!card_callbacks[i].callback) {
+            card_callbacks[i].callback = callback;
+            card_callbacks[i].user_data = user_data;
+            ret = ESP_OK;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&card_callback_lock);
+    return ret;
+}
+
+esp_err_t sd_manager_submit(sd_request_t *request, sd_priority_t priority) {
+    request->waiter = NULL;
+    return enqueue(request, priority);
+}
+
+esp_err_t sd_manager_execute(sd_request_t *request, sd_priority_t priority) {
+    if (!sd_task_handle || xTaskGetCurrentTaskHandle() == sd_task_handle) {
+        request->waiter = NULL;
+        process(request, true);
+        return request->result;
+    }
+    
+    request->waiter = xTaskGetCurrentTaskHandle();
+    esp_err_t ret = enqueue(request, priority);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    return request->result;
+}
+
+int sd_manager_scan_directory(const char *path, sd_listing_t *listing) {
+    sd_request_t request = {
+        .type = SD_REQUEST_LIST,
+        .path = path,
+        .list.listing = listing,
+    };
+    esp_err_t ret = sd_manager_execute(&request, SD_PRIORITY_LOW);
+    if (ret == ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "SD card not mounted");
+    }
+    return ret == ESP_OK ? request.list.count : -1;
+}
+
+bool sd_manager_file_exists(const char *path) {
+    sd_request_t request = {
+        .type = SD_REQUEST_STAT,
+        .path = path,
+    };
+    return sd_manager_execute(&request, SD_PRIORITY_HIGH) == ESP_OK;
+}
+
+size_t sd_manager_get_file_size(const char *path) {
+    sd_request_t request = {
+        .type = SD_REQUEST_STAT,
+        .path = path,
+    };
+    if (sd_manager_execute(&request, SD_PRIORITY_HIGH) != ESP_OK) {
+        return 0;
+    }
+    return request.stat.size;
+}
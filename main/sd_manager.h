@@ -2,17 +2,88 @@
 #define SD_MANAGER_H
 
 #include "esp_err.h"
+#include "sd_listing.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
 
 #define SD_MOUNT_POINT "/sdcard"
-#define MAX_FILENAME_LEN 64
+#define SD_HASH_LEN 32
+#define SD_RAW_BUFFER_ALIGN 128     // Cache line of PSRAM, DMA buffers must not share one
+#define SD_PRESENCE_POLL_MS 2000    // How often the SD task looks for card insertion and removal
+#define SD_PRESENCE_BACKOFF_MS 4000  // Longest wait between mounts of a card that keeps failing to mount
 
-typedef struct {
-    char name[MAX_FILENAME_LEN];
-    bool is_directory;
-    size_t size;
-} file_entry_t;
+typedef enum {
+    SD_PRIORITY_HIGH = 0,   // Small requests the UI waits on, served between slices of bulk work
+    SD_PRIORITY_LOW,        // Background listings, bulk reads, hashing and copies
+} sd_priority_t;
+
+typedef enum {
+    SD_REQUEST_LIST = 0,    // Fill list.listing with the entries of path
+    SD_REQUEST_STAT,        // Size, time and type of path
+    SD_REQUEST_READ,        // Read read.length bytes at read.offset of path
+    SD_REQUEST_HASH,        // SHA-256 of the whole file at path
+    SD_REQUEST_COPY,        // Copy path to copy.dest_path
+} sd_request_type_t;
+
+typedef enum {
+    SD_CARD_INSERTED = 0,   // A card was mounted after being absent
+    SD_CARD_REMOVED,        // The mounted card stopped answering and was unmounted
+} sd_card_event_t;
+
+/**
+ * @brief Card presence callback, runs on the SD task
+ * Must not block, touch LVGL or call back into the SD manager.
+ */
+typedef void (*sd_card_callback_t)(sd_card_event_t event, void *user_data);
+
+typedef struct sd_request sd_request_t;
+
+/**
+ * @brief Completion callback, runs on the SD task
+ * Must not block or touch LVGL; hand results to the UI through done_group.
+ */
+typedef void (*sd_request_callback_t)(sd_request_t *request);
+
+// One unit of card I/O, owned by the submitter until it completes
+struct sd_request {
+    sd_request_type_t type;
+    const char *path;                       // Relative to SD root, must stay valid until completion
+    union {
+        struct {
+            sd_listing_t *listing;          // Cleared, then filled
+            int count;                      // Output, number of entries
+        } list;
+        struct {
+            size_t size;                    // Output
+            time_t mtime;                   // Output
+            bool is_directory;              // Output
+        } stat;
+        struct {
+            size_t offset;
+            void *buffer;
+            size_t length;
+            size_t bytes_read;              // Output, less than length at the end of the file
+        } read;
+        struct {
+            uint8_t digest[SD_HASH_LEN];    // Output
+        } hash;
+        struct {
+            const char *dest_path;          // Relative to SD root, replaced if it exists
+            size_t bytes_copied;            // Output
+        } copy;
+    };
+    esp_err_t result;                       // Output
+    sd_request_callback_t callback;         // Called once done, may be NULL
+    void *user_data;                        // For the callback
+    EventGroupHandle_t done_group;          // Gets done_bits set once done, may be NULL
+    EventBits_t done_bits;
+    TaskHandle_t waiter;                    // Used by sd_manager_execute()
+};
 
 /**
  * @brief Initialize SD card manager
@@ -32,14 +103,54 @@ bool sd_manager_is_mounted(void);
  */
 esp_err_t sd_manager_deinit(void);
 
+/**
+ * @brief Get a counter bumped every time a card is mounted or unmounted
+ * Anything cached from the card is stale once the counter moves, even if the
+ * same card came back.
+ * @return Card generation
+ */
+uint32_t sd_manager_get_card_generation(void);
+
+/**
+ * @brief Get told when a card is inserted or removed
+ * The SD task checks the card every SD_PRESENCE_POLL_MS while idle. A card
+ * that answers but fails to mount is retried less often, up to every
+ * SD_PRESENCE_BACKOFF_MS.
+ * @param callback Callback, runs on the SD task
+ * @param user_data Passed to the callback
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if all listener slots are taken
+ */
+esp_err_t sd_manager_add_card_callback(sd_card_callback_t callback, void *user_data);
+
+/**
+ * @brief Queue a request for the SD task and return immediately
+ * All card access is done by one task. High priority requests are taken
+ * first, and also between the slices of a low priority read, hash or copy,
+ * so the UI never waits behind bulk work.
+ * @param request Request, must stay valid until its completion is signalled
+ * @param priority Queue to use
+ * @return ESP_OK if queued, error code otherwise
+ */
+esp_err_t sd_manager_submit(sd_request_t *request, sd_priority_t priority);
+
+/**
+ * @brief Run a request on the SD task and wait for it
+ * Runs in place when called from the SD task itself.
+ * @param request Request
+ * @param priority Queue to use
+ * @return Result of the request
+ */
+esp_err_t sd_manager_execute(sd_request_t *request, sd_priority_t priority);
+
 /**
  * @brief Scan directory and return file entries
+ * Name, size, attributes and mtime all come from one pass over the FAT
+ * directory, no per-entry stat(). Runs as a low priority request on the SD task.
  * @param path Directory path to scan (relative to SD root)
- * @param entries Array to store file entries
- * @param max_entries Maximum number of entries to return
+ * @param listing Cleared, then filled with every entry of the directory
  * @return Number of entries found, -1 on error
  */
-int sd_manager_scan_directory(const char *path, file_entry_t *entries, int max_entries);
+int sd_manager_scan_directory(const char *path, sd_listing_t *listing);
 
 /**
  * @brief Check if file exists
@@ -55,12 +166,98 @@ bool sd_manager_file_exists(const char *path);
  */
 size_t sd_manager_get_file_size(const char *path);
 
+// File opened straight through FatFs, for bulk reads without stdio buffering
+typedef struct sd_raw_file sd_raw_file_t;
+
+/**
+ * @brief Allocate a buffer the card can DMA into
+ * Cache-line aligned and DMA capable, PSRAM preferred. Reads into any other
+ * buffer are bounced one sector at a time.
+ * @param size Buffer size
+ * @return Buffer, free with heap_caps_free(). NULL if out of memory.
+ */
+void *sd_manager_raw_alloc(size_t size);
+
+/**
+ * @brief Open a file for raw reads
+ * For streaming consumers such as the flash pipeline, which bypass the SD task.
+ * @param path File path (relative to SD root)
+ * @param out Output file handle
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if missing, ESP_ERR_INVALID_STATE if not mounted
+ */
+esp_err_t sd_manager_raw_open(const char *path, sd_raw_file_t **out);
+
+/**
+ * @brief Read from a raw file
+ * While the file position is sector aligned, whole sectors go from the card
+ * straight into buf, up to a cluster per transfer. Keep the position and len
+ * multiples of sd_manager_raw_cluster_size() and buf from sd_manager_raw_alloc()
+ * for copy-free reads.
+ * @param file File handle
+ * @param buf Output buffer
+ * @param len Number of bytes wanted
+ * @param out_len Number of bytes read, less than len only at the end of the file
+ * @return ESP_OK on success, ESP_FAIL on I/O errors
+ */
+esp_err_t sd_manager_raw_read(sd_raw_file_t *file, void *buf, size_t len, size_t *out_len);
+
+/**
+ * @brief Move the read position of a raw file
+ * @param file File handle
+ * @param offset New position from the start of the file
+ * @return ESP_OK on success, ESP_ERR_INVALID_SIZE past the end of the file
+ */
+esp_err_t sd_manager_raw_seek(sd_raw_file_t *file, size_t offset);
+
+/**
+ * @brief Get the size of a raw file
+ * @param file File handle
+ * @return Size in bytes
+ */
+size_t sd_manager_raw_size(const sd_raw_file_t *file);
+
+/**
+ * @brief Get the cluster size of the volume a raw file is on
+ * @param file File handle
+ * @return Cluster size in bytes
+ */
+size_t sd_manager_raw_cluster_size(const sd_raw_file_t *file);
+
+/**
+ * @brief Close a raw file
+ * @param file File handle, may be NULL
+ */
+void sd_manager_raw_close(sd_raw_file_t *file);
+
+/**
+ * @brief Keep the card mounted while using it through stdio or VFS calls
+ * A card that stops answering is only unmounted once every user released it.
+ * Pair each successful call with sd_manager_fs_release(). Raw files and
+ * sd_manager_open_file() do this themselves.
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if not mounted
+ */
+esp_err_t sd_manager_fs_acquire(void);
+
+/**
+ * @brief Release a sd_manager_fs_acquire()
+ */
+void sd_manager_fs_release(void);
+
 /**
  * @brief Open file for reading/writing
+ * Goes through stdio, prefer sd_manager_raw_open() for bulk reads. The card
+ * stays mounted until sd_manager_close_file().
  * @param path File path (relative to SD root)
  * @param mode File open mode ("r", "w", "rb", "wb", etc.)
  * @return File pointer on success, NULL on error
  */
 FILE* sd_manager_open_file(const char *path, const char *mode);
 
+/**
+ * @brief Close a file from sd_manager_open_file()
+ * @param file File pointer
+ * @return Result of fclose()
+ */
+int sd_manager_close_file(FILE *file);
+
 #endif // SD_MANAGER_H
\ No newline at end of file